@@ -0,0 +1,85 @@
+/**
+ * bench_executor.h
+ */
+#ifndef BENCH_BENCH_EXECUTOR_H_
+#define BENCH_BENCH_EXECUTOR_H_
+
+#include <atomic>
+#include <future>
+#include <thread>
+#include "bench_util.h"
+#include "../concurrency/executor.h"
+
+namespace conc11 {
+
+namespace bench {
+
+/**
+ * Client threads submitting empty tasks to a pool of hardware_concurrency workers, against
+ * starting a thread or a std::async call per task. Round trip cases wait for every result, so
+ * their percentiles are submit to completion latencies. Fire and forget cases measure enqueue
+ * latency, and their throughput includes draining the queue. A bounded, blocking queue keeps
+ * producers from outrunning the workers.
+ */
+void bench_executor(Reporter& reporter) {
+    const BenchOptions& options = reporter.get_options();
+    size_t pool_size = std::max<size_t>(1, std::thread::hardware_concurrency());
+    ThreadPoolOptions bounded;
+    bounded.max_queue_size = 4096;
+    bounded.rejection_policy = RejectionPolicy::BLOCK;
+    ThreadPoolOptions stealing = bounded;
+    stealing.scheduling_mode = SchedulingMode::WORK_STEALING;
+    // The lock-free queue needs an unbounded shared queue, the ring itself bounds the backlog
+    // until it overflows.
+    ThreadPoolOptions lock_free;
+    lock_free.lock_free_queue_capacity = 4096;
+    const ThreadPoolOptions* modes[] = {&bounded, &stealing, &lock_free};
+    const char* mode_names[] = {"thread_pool_execute", "work_stealing_pool_execute",
+            "lock_free_pool_execute"};
+    for (size_t threads : options.threads) {
+        {
+            ThreadPoolExecutor exec(pool_size, pool_size, 0L, bounded);
+            reporter.report(run_case(options, "executor", "thread_pool_submit_get", threads,
+                    [&exec](size_t) {
+                        return [&exec]() {exec.submit([]() {}).get();};
+                    }));
+        }
+        {
+            ThreadPoolExecutor exec(pool_size, pool_size, 0L, bounded);
+            reporter.report(run_case(options, "executor", "thread_pool_async_get", threads,
+                    [&exec](size_t) {
+                        return [&exec]() {exec.async([]() {}).get();};
+                    }));
+        }
+        for (int mode = 0; mode < 3; ++mode) {
+            std::atomic<uint64_t> submitted(0);
+            std::atomic<uint64_t> executed(0);
+            ThreadPoolExecutor exec(pool_size, pool_size, 0L, *modes[mode]);
+            reporter.report(run_case(options, "executor", mode_names[mode], threads,
+                    [&](size_t) {
+                        return [&]() {
+                            submitted.fetch_add(1, std::memory_order_relaxed);
+                            exec.execute([&executed]() {
+                                executed.fetch_add(1, std::memory_order_relaxed);
+                            });
+                        };
+                    }, [&]() {
+                        while (executed.load() < submitted.load()) {
+                            std::this_thread::yield();
+                        }
+                    }));
+        }
+        reporter.report(run_case(options, "executor", "std_thread_join", threads, [](size_t) {
+            return []() {std::thread([]() {}).join();};
+        }));
+        reporter.report(run_case(options, "executor", "std_async_get", threads, [](size_t) {
+            return []() {std::async(std::launch::async, []() {}).get();};
+        }));
+    }
+}
+
+} // namespace bench
+
+} // namespace conc11
+
+#endif /* BENCH_BENCH_EXECUTOR_H_ */
@@ -0,0 +1,75 @@
+/**
+ * bench_lru_cache.h
+ */
+#ifndef BENCH_BENCH_LRU_CACHE_H_
+#define BENCH_BENCH_LRU_CACHE_H_
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "../concurrency/spin_lock.h"
+#include "../util/lru_cache.h"
+
+namespace conc11 {
+
+namespace bench {
+
+/**
+ * Threads look up keys drawn from a Zipf distribution over KEYS keys in a cache holding a tenth
+ * of them, inserting the key on a miss. Reports the hit ratio next to the throughput.
+ */
+template<class Mutex>
+void bench_zipf_lookup(Reporter& reporter, const std::string& name, size_t threads,
+                       double skew) {
+    static const size_t KEYS = 100000;
+    const BenchOptions& options = reporter.get_options();
+    BlockingLRUCache<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>, Mutex>
+            cache(KEYS / 10);
+    std::vector<uint64_t> hits(threads * CACHE_LINE_SIZE / sizeof(uint64_t));
+    std::vector<uint64_t> lookups(hits.size());
+    ZipfGenerator zipf(KEYS, skew, options.seed);
+    BenchResult r = run_case(options, "lru_cache", name, threads, [&](size_t t) {
+        ZipfGenerator keys(zipf);
+        keys.reseed(options.seed + t);
+        size_t slot = t * CACHE_LINE_SIZE / sizeof(uint64_t);
+        return [&cache, &hits, &lookups, keys, slot]() mutable {
+            uint64_t key = keys();
+            uint64_t value = 0;
+            if (cache.get_copy(key, &value)) {
+                ++hits[slot];
+            } else {
+                cache.set(key, key);
+            }
+            ++lookups[slot];
+        };
+    });
+    uint64_t total_hits = 0;
+    uint64_t total_lookups = 0;
+    for (size_t i = 0; i < hits.size(); ++i) {
+        total_hits += hits[i];
+        total_lookups += lookups[i];
+    }
+    r.extra.emplace_back("skew", skew);
+    r.extra.emplace_back("hit_ratio", total_lookups > 0 ?
+            static_cast<double>(total_hits) / static_cast<double>(total_lookups) : 0);
+    reporter.report(r);
+}
+
+void bench_lru_cache(Reporter& reporter) {
+    for (size_t threads : reporter.get_options().threads) {
+        for (double skew : {0.8, 0.99, 1.2}) {
+            bench_zipf_lookup<std::mutex>(reporter, "blocking_lru_cache_std_mutex", threads,
+                    skew);
+            bench_zipf_lookup<SpinLock>(reporter, "blocking_lru_cache_spin_lock", threads, skew);
+        }
+    }
+}
+
+} // namespace bench
+
+} // namespace conc11
+
+#endif /* BENCH_BENCH_LRU_CACHE_H_ */
@@ -0,0 +1,105 @@
+/**
+ * bench_main.cpp
+ *
+ * Benchmarks of the executors and synchronization primitives, printing one record per case and
+ * thread count. Build with optimizations, for example
+ *     g++ -std=c++11 -O2 -pthread bench/bench_main.cpp -o conc11_bench
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "bench_util.h"
+#include "bench_executor.h"
+#include "bench_lru_cache.h"
+#include "bench_semaphore.h"
+#include "bench_shared_mutex.h"
+#include "bench_spin_lock.h"
+
+namespace {
+
+void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--threads=1,2,4] [--duration-ms=200] [--filter=SUITE] "
+            "[--format=json|csv] [--sample-every=16] [--seed=42]\n"
+            "Suites: executor, semaphore, shared_mutex, spin_lock, lru_cache\n", program);
+}
+
+std::vector<size_t> parse_threads(const char* list) {
+    std::vector<size_t> threads;
+    for (const char* p = list; *p;) {
+        char* end = nullptr;
+        unsigned long n = strtoul(p, &end, 10);
+        if (end == p || n == 0) {
+            return std::vector<size_t>();
+        }
+        threads.push_back(n);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return threads;
+}
+
+/**
+ * Returns the value of --name=value in arg, or nullptr if arg is another option.
+ */
+const char* option_value(const char* arg, const char* name) {
+    size_t len = strlen(name);
+    return strncmp(arg, name, len) == 0 && arg[len] == '=' ? arg + len + 1 : nullptr;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    using namespace conc11::bench;
+    BenchOptions options;
+    options.threads = BenchOptions::default_threads();
+    for (int i = 1; i < argc; ++i) {
+        const char* v;
+        if ((v = option_value(argv[i], "--threads"))) {
+            options.threads = parse_threads(v);
+            if (options.threads.empty()) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if ((v = option_value(argv[i], "--duration-ms"))) {
+            options.duration = std::chrono::milliseconds(strtoul(v, nullptr, 10));
+        } else if ((v = option_value(argv[i], "--filter"))) {
+            options.filter = v;
+        } else if ((v = option_value(argv[i], "--format"))) {
+            if (strcmp(v, "json") == 0) {
+                options.format = Format::JSON;
+            } else if (strcmp(v, "csv") == 0) {
+                options.format = Format::CSV;
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if ((v = option_value(argv[i], "--sample-every"))) {
+            options.sample_every = strtoul(v, nullptr, 10);
+        } else if ((v = option_value(argv[i], "--seed"))) {
+            options.seed = strtoull(v, nullptr, 10);
+        } else {
+            usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 2;
+        }
+    }
+
+    Reporter reporter(options);
+    reporter.print_header();
+    if (reporter.selected("executor")) {
+        bench_executor(reporter);
+    }
+    if (reporter.selected("semaphore")) {
+        bench_semaphore(reporter);
+    }
+    if (reporter.selected("shared_mutex")) {
+        bench_shared_mutex(reporter);
+    }
+    if (reporter.selected("spin_lock")) {
+        bench_spin_lock(reporter);
+    }
+    if (reporter.selected("lru_cache")) {
+        bench_lru_cache(reporter);
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+/**
+ * bench_semaphore.h
+ */
+#ifndef BENCH_BENCH_SEMAPHORE_H_
+#define BENCH_BENCH_SEMAPHORE_H_
+
+#include <mutex>
+#include <string>
+#include "bench_util.h"
+#include "../concurrency/rate_limiter.h"
+#include "../concurrency/semaphore.h"
+
+namespace conc11 {
+
+namespace bench {
+
+/**
+ * Every operation acquires and releases one permit. With permits for half of the threads, about
+ * half of the acquisitions have to wait, with permits for all of them none has to.
+ */
+template<class Semaphore>
+void bench_acquire_release(Reporter& reporter, const std::string& name, size_t threads,
+                           size_t permits) {
+    Semaphore sem(static_cast<int>(permits));
+    reporter.report(run_case(reporter.get_options(), "semaphore", name, threads,
+            [&sem](size_t) {
+                return [&sem]() {
+                    sem.acquire();
+                    sem.release();
+                };
+            }));
+}
+
+void bench_semaphore(Reporter& reporter) {
+    for (size_t threads : reporter.get_options().threads) {
+        size_t half = threads > 1 ? threads / 2 : 1;
+        bench_acquire_release<QueuedSemaphore<std::mutex>>(reporter, "queued_semaphore",
+                threads, half);
+        bench_acquire_release<SimpleSemaphore<std::mutex>>(reporter, "simple_semaphore",
+                threads, half);
+        bench_acquire_release<QueuedSemaphore<std::mutex>>(reporter,
+                "queued_semaphore_uncontended", threads, threads);
+        bench_acquire_release<SimpleSemaphore<std::mutex>>(reporter,
+                "simple_semaphore_uncontended", threads, threads);
+#if defined(__linux__)
+        bench_acquire_release<FutexSemaphore>(reporter, "futex_semaphore", threads, half);
+        bench_acquire_release<FutexSemaphore>(reporter, "futex_semaphore_uncontended", threads,
+                threads);
+#endif
+        // A rate far above what the threads can ask for, so that every acquisition takes the
+        // single compare-and-swap of the fast path
+        RateLimiter limiter(1e12, 1e6);
+        reporter.report(run_case(reporter.get_options(), "semaphore", "rate_limiter_try_acquire",
+                threads, [&limiter](size_t) {
+                    return [&limiter]() {limiter.try_acquire();};
+                }));
+    }
+}
+
+} // namespace bench
+
+} // namespace conc11
+
+#endif /* BENCH_BENCH_SEMAPHORE_H_ */
@@ -0,0 +1,67 @@
+/**
+ * bench_shared_mutex.h
+ */
+#ifndef BENCH_BENCH_SHARED_MUTEX_H_
+#define BENCH_BENCH_SHARED_MUTEX_H_
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include "bench_util.h"
+#include "../concurrency/shared_mutex.h"
+#include "../pthread_wrapper/pthread_shared_mutex.h"
+
+namespace conc11 {
+
+namespace bench {
+
+/**
+ * Threads read a small table under a shared lock, and write it under an exclusive lock with
+ * probability write_percent / 100.
+ */
+template<class Mutex>
+void bench_read_mostly(Reporter& reporter, const std::string& name, size_t threads,
+                       unsigned write_percent) {
+    const BenchOptions& options = reporter.get_options();
+    Mutex mtx;
+    uint64_t table[8] = {};
+    BenchResult r = run_case(options, "shared_mutex", name, threads, [&](size_t t) {
+        std::mt19937_64 rng(options.seed + t);
+        return [&mtx, &table, rng, write_percent]() mutable {
+            uint64_t x = rng();
+            if (x % 100 < write_percent) {
+                std::lock_guard<Mutex> lock(mtx);
+                ++table[x % 8];
+            } else {
+                SharedLock<Mutex> lock(mtx);
+                uint64_t sum = 0;
+                for (uint64_t v : table) {
+                    sum += v;
+                }
+                volatile uint64_t sink = sum;
+                (void) sink;
+            }
+        };
+    });
+    r.extra.emplace_back("write_percent", write_percent);
+    reporter.report(r);
+}
+
+void bench_shared_mutex(Reporter& reporter) {
+    for (size_t threads : reporter.get_options().threads) {
+        for (unsigned write_percent : {1u, 10u, 50u}) {
+            bench_read_mostly<SharedTimedMutex>(reporter, "shared_timed_mutex", threads,
+                    write_percent);
+            bench_read_mostly<ReaderPreferringSharedTimedMutex>(reporter,
+                    "reader_preferring_shared_timed_mutex", threads, write_percent);
+            bench_read_mostly<PThreadSharedMutex>(reporter, "pthread_shared_mutex", threads,
+                    write_percent);
+        }
+    }
+}
+
+} // namespace bench
+
+} // namespace conc11
+
+#endif /* BENCH_BENCH_SHARED_MUTEX_H_ */
@@ -0,0 +1,48 @@
+/**
+ * bench_spin_lock.h
+ */
+#ifndef BENCH_BENCH_SPIN_LOCK_H_
+#define BENCH_BENCH_SPIN_LOCK_H_
+
+#include <mutex>
+#include <string>
+#include "bench_util.h"
+#include "../concurrency/spin_lock.h"
+#include "../pthread_wrapper/pthread_spinlock.h"
+
+namespace conc11 {
+
+namespace bench {
+
+/**
+ * Every operation increments a counter shared by all threads under the lock.
+ */
+template<class Lock>
+void bench_lock_increment(Reporter& reporter, const std::string& name, size_t threads) {
+    Lock lock;
+    uint64_t counter = 0;
+    BenchResult r = run_case(reporter.get_options(), "spin_lock", name, threads,
+            [&](size_t) {
+                return [&]() {
+                    std::lock_guard<Lock> guard(lock);
+                    ++counter;
+                };
+            });
+    r.extra.emplace_back("counter", static_cast<double>(counter));
+    reporter.report(r);
+}
+
+void bench_spin_lock(Reporter& reporter) {
+    for (size_t threads : reporter.get_options().threads) {
+        bench_lock_increment<SpinLock>(reporter, "spin_lock", threads);
+        bench_lock_increment<FairSpinLock>(reporter, "fair_spin_lock", threads);
+        bench_lock_increment<PThreadSpinLockWrapper>(reporter, "pthread_spin_lock", threads);
+        bench_lock_increment<std::mutex>(reporter, "std_mutex", threads);
+    }
+}
+
+} // namespace bench
+
+} // namespace conc11
+
+#endif /* BENCH_BENCH_SPIN_LOCK_H_ */
@@ -0,0 +1,295 @@
+/**
+ * bench_util.h
+ */
+#ifndef BENCH_BENCH_UTIL_H_
+#define BENCH_BENCH_UTIL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "../util/util.h"
+
+namespace conc11 {
+
+namespace bench {
+
+enum class Format {
+    // One JSON object per line
+    JSON,
+    // Comma separated values with a header line
+    CSV
+};
+
+/**
+ * Settings shared by all benchmarks. The defaults give reproducible runs of a few seconds per
+ * suite.
+ */
+struct BenchOptions {
+    // Client thread counts to sweep
+    std::vector<size_t> threads;
+    // Measured time of every case
+    std::chrono::milliseconds duration = std::chrono::milliseconds(200);
+    // Only run suites whose name contains this
+    std::string filter;
+    Format format = Format::JSON;
+    // Time one operation out of this many for the latency percentiles, as reading the clock
+    // would dominate the cheapest operations
+    size_t sample_every = 16;
+    // Seed of all random number generators
+    uint64_t seed = 42;
+
+    /**
+     * Powers of two from 1 to twice the hardware concurrency.
+     */
+    static std::vector<size_t> default_threads() {
+        size_t hw = std::max<size_t>(1, std::thread::hardware_concurrency());
+        std::vector<size_t> threads;
+        for (size_t n = 1; n <= 2 * hw; n *= 2) {
+            threads.push_back(n);
+        }
+        return threads;
+    }
+};
+
+/**
+ * Result of one case at one thread count. Latencies are in nanoseconds.
+ */
+struct BenchResult {
+    std::string suite;
+    std::string name;
+    size_t threads = 0;
+    uint64_t ops = 0;
+    double seconds = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double p999 = 0;
+    double max = 0;
+    // Case specific figures such as a hit ratio
+    std::vector<std::pair<std::string, double>> extra;
+
+    double ops_per_second() const noexcept {
+        return seconds > 0 ? static_cast<double>(ops) / seconds : 0;
+    }
+};
+
+/**
+ * Prints results as they come in the configured format.
+ */
+class Reporter {
+public:
+    explicit Reporter(const BenchOptions& options) : options(options) {
+    }
+
+    /**
+     * Describe the run, so that results from different machines and builds can be told apart.
+     */
+    void print_header() {
+        unsigned hw = std::thread::hardware_concurrency();
+        long long duration = static_cast<long long>(options.duration.count());
+        if (options.format == Format::JSON) {
+            printf("{\"type\":\"run\",\"hardware_concurrency\":%u,\"duration_ms\":%lld,"
+                    "\"sample_every\":%zu,\"seed\":%llu,\"compiler\":\"%s\",\"cplusplus\":%ld}\n",
+                    hw, duration, options.sample_every,
+                    static_cast<unsigned long long>(options.seed), __VERSION__,
+                    static_cast<long>(__cplusplus));
+        } else {
+            printf("# hardware_concurrency=%u duration_ms=%lld sample_every=%zu seed=%llu "
+                    "compiler=%s\n", hw, duration, options.sample_every,
+                    static_cast<unsigned long long>(options.seed), __VERSION__);
+            printf("suite,case,threads,ops,seconds,ops_per_sec,p50_ns,p90_ns,p99_ns,p999_ns,"
+                    "max_ns,extra\n");
+        }
+        fflush(stdout);
+    }
+
+    void report(const BenchResult& r) {
+        if (options.format == Format::JSON) {
+            printf("{\"type\":\"result\",\"suite\":\"%s\",\"case\":\"%s\",\"threads\":%zu,"
+                    "\"ops\":%llu,\"seconds\":%.6f,\"ops_per_sec\":%.1f,\"p50_ns\":%.0f,"
+                    "\"p90_ns\":%.0f,\"p99_ns\":%.0f,\"p999_ns\":%.0f,\"max_ns\":%.0f",
+                    r.suite.c_str(), r.name.c_str(), r.threads,
+                    static_cast<unsigned long long>(r.ops), r.seconds, r.ops_per_second(),
+                    r.p50, r.p90, r.p99, r.p999, r.max);
+            for (const auto& e : r.extra) {
+                printf(",\"%s\":%.6g", e.first.c_str(), e.second);
+            }
+            printf("}\n");
+        } else {
+            printf("%s,%s,%zu,%llu,%.6f,%.1f,%.0f,%.0f,%.0f,%.0f,%.0f,", r.suite.c_str(),
+                    r.name.c_str(), r.threads, static_cast<unsigned long long>(r.ops), r.seconds,
+                    r.ops_per_second(), r.p50, r.p90, r.p99, r.p999, r.max);
+            for (size_t i = 0; i < r.extra.size(); ++i) {
+                printf("%s%s=%.6g", i > 0 ? ";" : "", r.extra[i].first.c_str(),
+                        r.extra[i].second);
+            }
+            printf("\n");
+        }
+        fflush(stdout);
+    }
+
+    bool selected(const std::string& suite) const {
+        return options.filter.empty() || suite.find(options.filter) != std::string::npos;
+    }
+
+    const BenchOptions& get_options() const noexcept {
+        return options;
+    }
+
+private:
+    const BenchOptions& options;
+};
+
+namespace detail {
+
+inline int64_t bench_clock() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Nearest rank percentile of sorted samples, 0 < q <= 1.
+ */
+inline double percentile(const std::vector<int64_t>& sorted, double q) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(q * static_cast<double>(sorted.size())));
+    return static_cast<double>(sorted[rank > 0 ? rank - 1 : 0]);
+}
+
+struct ThreadTally {
+    uint64_t ops = 0;
+    std::vector<int64_t> samples;
+    // Keep the sample vectors of neighbouring threads off each other's cache line
+    char padding[CACHE_LINE_SIZE];
+};
+
+} // namespace detail
+
+/**
+ * Run a case on threads client threads for the configured duration. Every thread calls
+ * make_op(thread_index) once to get its operation, then calls it until the time is up. After
+ * the threads stop, drain() is called and its time counts towards the run, so that work the
+ * operations left behind, such as queued tasks, is included in the throughput.
+ */
+template<class MakeOp, class Drain>
+BenchResult run_case(const BenchOptions& options, const std::string& suite,
+                     const std::string& name, size_t threads, MakeOp make_op, Drain drain) {
+    std::vector<detail::ThreadTally> tallies(threads);
+    std::atomic<size_t> ready(0);
+    std::atomic<bool> go(false);
+    std::atomic<bool> stop(false);
+    const size_t sample_every = options.sample_every > 0 ? options.sample_every : 1;
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            auto op = make_op(t);
+            detail::ThreadTally& tally = tallies[t];
+            ready.fetch_add(1);
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            uint64_t n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (n % sample_every == 0) {
+                    int64_t start = detail::bench_clock();
+                    op();
+                    tally.samples.push_back(detail::bench_clock() - start);
+                } else {
+                    op();
+                }
+                ++n;
+            }
+            tally.ops = n;
+        });
+    }
+    while (ready.load() < threads) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true);
+    std::this_thread::sleep_for(options.duration);
+    stop.store(true);
+    for (auto& w : workers) {
+        w.join();
+    }
+    drain();
+    auto end = std::chrono::steady_clock::now();
+
+    BenchResult r;
+    r.suite = suite;
+    r.name = name;
+    r.threads = threads;
+    r.seconds = std::chrono::duration<double>(end - start).count();
+    std::vector<int64_t> samples;
+    for (const auto& tally : tallies) {
+        r.ops += tally.ops;
+        samples.insert(samples.end(), tally.samples.begin(), tally.samples.end());
+    }
+    std::sort(samples.begin(), samples.end());
+    r.p50 = detail::percentile(samples, 0.5);
+    r.p90 = detail::percentile(samples, 0.9);
+    r.p99 = detail::percentile(samples, 0.99);
+    r.p999 = detail::percentile(samples, 0.999);
+    r.max = samples.empty() ? 0 : static_cast<double>(samples.back());
+    return r;
+}
+
+template<class MakeOp>
+BenchResult run_case(const BenchOptions& options, const std::string& suite,
+                     const std::string& name, size_t threads, MakeOp make_op) {
+    return run_case(options, suite, name, threads, make_op, []() {});
+}
+
+/**
+ * Draws integers in [0, n) where k has a probability proportional to 1 / (k + 1)^s, as in
+ * skewed cache workloads. Copies share the distribution table, but not the random engine, so
+ * give each thread its own copy and reseed it.
+ */
+class ZipfGenerator {
+public:
+    ZipfGenerator(size_t n, double s, uint64_t seed) :
+            cdf(std::make_shared<std::vector<double>>(n)), rng(seed), uniform(0.0, 1.0) {
+        std::vector<double>& c = *cdf;
+        double sum = 0;
+        for (size_t k = 0; k < n; ++k) {
+            sum += 1.0 / std::pow(static_cast<double>(k + 1), s);
+            c[k] = sum;
+        }
+        for (double& p : c) {
+            p /= sum;
+        }
+    }
+
+    void reseed(uint64_t seed) {
+        rng.seed(seed);
+    }
+
+    size_t operator()() {
+        const std::vector<double>& c = *cdf;
+        size_t k = std::lower_bound(c.begin(), c.end(), uniform(rng)) - c.begin();
+        return k < c.size() ? k : c.size() - 1;
+    }
+
+private:
+    std::shared_ptr<std::vector<double>> cdf;
+    std::mt19937_64 rng;
+    std::uniform_real_distribution<double> uniform;
+};
+
+} // namespace bench
+
+} // namespace conc11
+
+#endif /* BENCH_BENCH_UTIL_H_ */
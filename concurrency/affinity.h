@@ -0,0 +1,166 @@
+/**
+ * affinity.h
+ * CPU topology discovery and thread pinning. Discovery reads Linux sysfs, and pinning uses
+ * pthread_setaffinity_np. On other platforms the topology is a single node and pinning fails.
+ */
+#ifndef CONCURRENCY_AFFINITY_H_
+#define CONCURRENCY_AFFINITY_H_
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace conc11 {
+
+/**
+ * Parse a CPU list in the format of Linux sysfs and cpusets, such as "0-3,8,10-11".
+ * Malformed entries are skipped.
+ */
+inline std::vector<int> parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        char* end = nullptr;
+        long first = std::strtol(range.c_str(), &end, 10);
+        if (end == range.c_str() || first < 0) {
+            continue;
+        }
+        long last = first;
+        if (*end == '-') {
+            const char* begin = end + 1;
+            last = std::strtol(begin, &end, 10);
+            if (end == begin || last < first) {
+                continue;
+            }
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return cpus;
+}
+
+/**
+ * CPUs of the machine grouped by NUMA node, restricted to those the process may run on.
+ */
+class CpuTopology {
+public:
+    /**
+     * Topology from sysfs, or a single node holding CPUs 0 to hardware_concurrency() - 1 if
+     * unavailable.
+     */
+    static CpuTopology detect() {
+        CpuTopology topology;
+        std::vector<int> allowed = allowed_cpus();
+        for (int node : parse_cpu_list(read_line("/sys/devices/system/node/online"))) {
+            std::vector<int> cpus = parse_cpu_list(read_line(
+                    "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+            if (!allowed.empty()) {
+                cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [&allowed](int cpu) {
+                    return !std::binary_search(allowed.begin(), allowed.end(), cpu);
+                }), cpus.end());
+            }
+            if (!cpus.empty()) {
+                topology.nodes.push_back(std::move(cpus));
+            }
+        }
+        if (topology.nodes.empty()) {
+            if (allowed.empty()) {
+                unsigned n = std::thread::hardware_concurrency();
+                for (unsigned cpu = 0; cpu < (n > 0 ? n : 1); ++cpu) {
+                    allowed.push_back(static_cast<int>(cpu));
+                }
+            }
+            topology.nodes.push_back(std::move(allowed));
+        }
+        return topology;
+    }
+
+    /**
+     * A topology of the given nodes, for machines sysfs does not describe well.
+     */
+    explicit CpuTopology(std::vector<std::vector<int>> nodes = std::vector<std::vector<int>>()) :
+            nodes(std::move(nodes)) {
+    }
+
+    size_t node_count() const noexcept {
+        return nodes.size();
+    }
+
+    /**
+     * CPUs of every node, one vector per node.
+     */
+    const std::vector<std::vector<int>>& get_nodes() const noexcept {
+        return nodes;
+    }
+
+    std::vector<int> all_cpus() const {
+        std::vector<int> cpus;
+        for (const auto& node : nodes) {
+            cpus.insert(cpus.end(), node.begin(), node.end());
+        }
+        return cpus;
+    }
+
+private:
+    static std::string read_line(const std::string& path) {
+        std::ifstream in(path);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+
+    /**
+     * CPUs in the affinity mask of the process in ascending order, empty if unknown.
+     */
+    static std::vector<int> allowed_cpus() {
+        std::vector<int> cpus;
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+#endif
+        return cpus;
+    }
+
+    std::vector<std::vector<int>> nodes;
+};
+
+/**
+ * Restrict the calling thread to the given CPUs. Returns false if that is not supported or
+ * failed, for example because none of the CPUs exist.
+ */
+inline bool set_current_thread_affinity(const std::vector<int>& cpus) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void) cpus;
+    return false;
+#endif
+}
+
+} // namespace conc11
+
+#endif /* CONCURRENCY_AFFINITY_H_ */
@@ -4,54 +4,158 @@
 #ifndef CONCURRENCY_EXECUTOR_H_
 #define CONCURRENCY_EXECUTOR_H_
 
+#include <atomic>
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <future>
-#include <queue>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "affinity.h"
+#include "executor_metrics.h"
+#include "future.h"
+#include "mpmc_queue.h"
+#include "task_queue.h"
+#include "work_stealing_deque.h"
 #include "../util/util.h"
 
 namespace conc11 {
 
-class ExecutorBase {
-protected:
-    class TaskBase {
-    public:
-        virtual ~TaskBase(){
-        }
+/**
+ * How a ThreadPoolExecutor distributes tasks among its workers.
+ */
+enum class SchedulingMode {
+    // All tasks go through one FIFO queue protected by the executor lock.
+    SHARED_QUEUE,
+    // Every worker owns a work-stealing deque. Tasks submitted from inside a worker are pushed to
+    // its own deque without locking, tasks submitted from other threads land in a shared
+    // injection queue, and idle workers steal from their peers.
+    WORK_STEALING
+};
 
-        virtual void operator()() = 0;
-    protected:
-        TaskBase() = default;
+/**
+ * What a ThreadPoolExecutor with a bounded queue does with a task submitted while the queue is
+ * full.
+ */
+enum class RejectionPolicy {
+    // Block the submitting thread until there is room, or fail with std::errc::timed_out after
+    // block_timeout. Submitting from inside the pool may deadlock once all workers block.
+    BLOCK,
+    // Run the task in the submitting thread.
+    CALLER_RUNS,
+    // Drop a queued task to make room: the oldest of the least urgent ones, as chosen by
+    // TaskQueue::pop_least_urgent(). Futures of dropped tasks become broken promises.
+    DISCARD_OLDEST,
+    // Fail with std::errc::resource_unavailable_try_again.
+    THROW
+};
 
-        TaskBase(const TaskBase&) = delete;
-        TaskBase& operator=(const TaskBase&) = delete;
-    };
+/**
+ * Optional settings of a ThreadPoolExecutor.
+ */
+struct ThreadPoolOptions {
+    SchedulingMode scheduling_mode = SchedulingMode::SHARED_QUEUE;
+    // Capacity of each worker deque in WORK_STEALING mode. Tasks spill to the injection queue
+    // when the submitting worker's deque is full.
+    size_t local_queue_capacity = 256;
+    // Order of the shared queue, see TaskQueue. Tasks that workers push to their own deques in
+    // WORK_STEALING mode bypass it and run in deque order.
+    QueueDiscipline queue_discipline = QueueDiscipline::FIFO;
+    // Capacity of a lock-free MPMC queue that tasks go through ahead of the shared queue, 0 for
+    // none. Submitters and workers then take the executor lock only to park and wake workers.
+    // Only used by fixed size pools with an unbounded FIFO queue and without adaptive sizing.
+    // Tasks with a domain, priority, deadline or tenant, and all tasks while there are several
+    // tenants, take the shared queue. Tasks overflowing a full ring may run before earlier ones.
+    size_t lock_free_queue_capacity = 0;
+    // Number of priority lanes in PRIORITY_LANES mode.
+    size_t priority_levels = 3;
+    // A task waiting this long in PRIORITY_LANES mode is treated as one priority level higher.
+    std::chrono::nanoseconds aging_interval = std::chrono::milliseconds(100);
+    // Relative deadline of tasks submitted without one in EARLIEST_DEADLINE_FIRST mode.
+    std::chrono::nanoseconds default_deadline = std::chrono::seconds(1);
+    // Capacity of the shared queue, 0 for unbounded. Tasks that workers push to their own deques
+    // in WORK_STEALING mode do not count. Bulk submissions apply the rejection policy per task,
+    // and stop at the first task rejected with an exception.
+    size_t max_queue_size = 0;
+    RejectionPolicy rejection_policy = RejectionPolicy::BLOCK;
+    // How long BLOCK waits for room, forever by default.
+    std::chrono::nanoseconds block_timeout = std::chrono::nanoseconds::max();
+    // A worker running out of tasks polls for new ones idle_spin_count times, pausing the CPU in
+    // between, then idle_yield_count times, yielding in between, before blocking. A spinning
+    // worker picks up a new task without the submitter waking it, trading CPU time for latency.
+    size_t idle_spin_count = 0;
+    size_t idle_yield_count = 0;
+    // Collect the metrics returned by get_metrics(). Workers keep their own counters, so this
+    // costs a few clock reads per task but no shared writes.
+    bool enable_metrics = false;
+    // CPUs of each placement domain, typically one domain per NUMA node as returned by
+    // CpuTopology::get_nodes(). Workers are spread evenly over the domains and restricted to the
+    // CPUs of their domain. Every domain has its own shared queue, which its workers drain before
+    // taking tasks queued for other domains. Empty for no placement.
+    std::vector<std::vector<int>> placement_domains;
+    // Pin every worker to a single CPU of its domain, spreading workers over the CPUs.
+    bool pin_to_core = false;
+    // Size the pool between core_pool_size and max_pool_size with a controller thread, rather
+    // than adding a worker whenever a task finds none idle and retiring non-core workers after
+    // the timeout. Every sizing_interval the controller measures how long tasks waited in the
+    // shared queues and how many were taken. It grows the pool after grow_after_samples
+    // consecutive samples in which tasks waited target_queue_wait or longer with no worker
+    // idle, and retires a non-core worker after shrink_after_samples consecutive samples with
+    // idle workers and an empty queue. Growth pauses while the last growth did not raise
+    // throughput, and the pool is resized at most once per min_resize_interval. Submitting
+    // never starts threads in this mode.
+    bool adaptive_sizing = false;
+    std::chrono::nanoseconds sizing_interval = std::chrono::milliseconds(10);
+    std::chrono::nanoseconds target_queue_wait = std::chrono::milliseconds(1);
+    size_t grow_after_samples = 2;
+    size_t shrink_after_samples = 50;
+    std::chrono::nanoseconds min_resize_interval = std::chrono::milliseconds(20);
+};
 
-    template<class RetType>
-    class Task : public TaskBase {
-    public:
-        explicit Task(std::packaged_task<RetType()>&& task) noexcept :task(std::move(task)) {
-        }
+namespace detail {
 
-        virtual void operator()() override {
-            task();
-        }
-    private:
-        std::packaged_task<RetType()> task;
-    };
+/**
+ * Returns true if get() on f would not block. Deferred std::futures count as ready, as get()
+ * runs them in the calling thread.
+ */
+template<class T>
+bool future_is_ready(const std::future<T>& f) {
+    return f.wait_for(std::chrono::seconds(0)) != std::future_status::timeout;
+}
 
+template<class T>
+bool future_is_ready(const std::shared_future<T>& f) {
+    return f.wait_for(std::chrono::seconds(0)) != std::future_status::timeout;
+}
+
+template<class T>
+bool future_is_ready(const Future<T>& f) {
+    return f.is_ready();
+}
+
+} // namespace detail
+
+class ExecutorBase {
+protected:
+    /**
+     * Wraps a callable submitted through execute(). Swallows exceptions as there are no means to
+     * retrive neither results nor exceptions.
+     */
     template<class Runnable>
-    class UntrackableTask : public TaskBase {
+    class UntrackableTask {
     public:
         explicit UntrackableTask(Runnable&& r) noexcept:r(std::forward<Runnable>(r)) {
         }
 
-        virtual void operator()() override {
+        void operator()() {
             try {
                 r();
             } catch (...) {
-                // Swallows exceptions from RunnableTask as there are no means to retrive neither
-                // results nor exceptions
             }
         }
 
@@ -59,6 +163,27 @@ protected:
         typename std::remove_reference<Runnable>::type r;
     };
 
+    /**
+     * Wraps a callable submitted through async(), completing a conc11::Promise with its result.
+     */
+    template<class RetType, class Runnable>
+    class PromiseTask {
+    public:
+        PromiseTask(Promise<RetType>&& p, Runnable&& r) noexcept:
+        p(std::move(p)), r(std::forward<Runnable>(r)) {
+        }
+
+        PromiseTask(PromiseTask&&) = default;
+
+        void operator()() {
+            detail::set_promise_from(p, r);
+        }
+
+    private:
+        Promise<RetType> p;
+        typename std::remove_reference<Runnable>::type r;
+    };
+
     ExecutorBase() = default;
     ExecutorBase(const ExecutorBase&) = delete;
     ExecutorBase& operator=(const ExecutorBase&) = delete;
@@ -72,16 +197,37 @@ class ThreadPoolExecutor : public ExecutorBase{
 public:
     ThreadPoolExecutor(size_t core_pool_size,
              size_t max_pool_size,
-             std::chrono::nanoseconds::rep timeout_nanoseconds) :
+             std::chrono::nanoseconds::rep timeout_nanoseconds,
+             const ThreadPoolOptions& options = ThreadPoolOptions()) :
             core_pool_size(core_pool_size), max_pool_size(max_pool_size),
-                    timeout_nanoseconds(timeout_nanoseconds),
-                    shut(false), active_count(0) {
-        for (size_t i = 0; i < core_pool_size; ++i) {
-            add_worker_locked(true);
-        }
+                    timeout_nanoseconds(timeout_nanoseconds), options(options),
+                    shut(false), active_count(0), idle_count(0), spinning_count(0),
+                    work_epoch(0), waiting_submitters(0),
+                    rejected_count(0), discarded_count(0), blocked_count(0),
+                    peak_queue_depth(0) {
         size_t max_threads = core_pool_size < max_pool_size ? max_pool_size : core_pool_size;
         workers.reserve(max_threads);
         dead_workers.reserve(max_threads);
+        tenants.emplace_back(new Tenant("default", 1));
+        if (options.lock_free_queue_capacity > 0 && core_pool_size > 0 &&
+                core_pool_size >= max_pool_size && options.max_queue_size == 0 &&
+                options.queue_discipline == QueueDiscipline::FIFO && !options.adaptive_sizing) {
+            ring.reset(new MPMCQueue<UniqueTask>(options.lock_free_queue_capacity));
+        }
+        size_t domains = options.placement_domains.empty() ? 1 : options.placement_domains.size();
+        for (size_t i = 0; i < domains; ++i) {
+            task_queues.emplace_back(new TaskQueue(options.queue_discipline,
+                    options.priority_levels, options.aging_interval, options.default_deadline,
+                    &tenants[0]->usage));
+        }
+        // Workers scan the worker list when stealing, so hold the lock while populating it.
+        std::lock_guard<std::mutex> lock(main_lock);
+        for (size_t i = 0; i < core_pool_size; ++i) {
+            add_worker_locked(true);
+        }
+        if (options.adaptive_sizing) {
+            sizing_thread = std::thread(&ThreadPoolExecutor::run_sizing, this);
+        }
     }
 
     ~ThreadPoolExecutor() {
@@ -89,10 +235,18 @@ public:
             shutdown();
             await_termination();
         }
+        if (sizing_thread.joinable()) {
+            sizing_thread.join();
+        }
         // Destructor shall not be called from multiple threads so safe to use _locked methods.
         reap_dead_workers_locked();
     }
 
+    // Placement domain argument of submit_on() and execute_on() leaving the choice to the executor
+    static const size_t ANY_DOMAIN = static_cast<size_t>(-1);
+    // Tenant of tasks submitted without one
+    static const size_t DEFAULT_TENANT = 0;
+
     /**
      * Submits a callable and its parameters to be executed at some time in the future.
      * The callable object and parameters will be stored using std::bind. The retsult and possible
@@ -100,21 +254,111 @@ public:
      */
     template<typename Callable, typename ... Args>
     auto submit(Callable&& c, Args&&... args)
-    -> std::future<decltype(invoke(std::forward<Callable>(c), std::forward<Args>(args)...))> {
+    -> std::future<decltype(conc11::invoke(std::forward<Callable>(c),
+            std::forward<Args>(args)...))> {
+        return submit_on(ANY_DOMAIN, std::forward<Callable>(c), std::forward<Args>(args)...);
+    }
+
+    /**
+     * Submits a callable like submit() to the queue of a placement domain, so that it preferably
+     * runs on a worker of that domain, for example the NUMA node holding its data. The domain is
+     * taken modulo the number of domains. Without a domain, tasks submitted from a worker go to
+     * the queue of its domain and others are spread round robin.
+     */
+    template<typename Callable, typename ... Args>
+    auto submit_on(size_t domain, Callable&& c, Args&&... args)
+    -> std::future<decltype(conc11::invoke(std::forward<Callable>(c),
+            std::forward<Args>(args)...))> {
         using RetType = decltype(
-                invoke(std::forward<Callable>(c), std::forward<Args>(args)...));
+                conc11::invoke(std::forward<Callable>(c), std::forward<Args>(args)...));
 
         if (shut.load()) {
             throw(std::system_error(std::make_error_code(std::errc::permission_denied)));
         }
+        // The bound callable is stored in the shared state of packaged_task, which is the only
+        // allocation here as the packaged_task itself fits in UniqueTask.
         std::packaged_task<RetType()> task(
                 std::bind(std::forward<Callable>(c), std::forward<Args>(args)...));
         std::future<RetType> f = task.get_future();
-        auto uptr_task = conc11::make_unique<Task<RetType>>(std::move(task));
-        {
-            std::lock_guard<std::mutex> lock(main_lock);
-            insert_task_locked(std::move(uptr_task));
+        enqueue_task(UniqueTask(std::move(task)), domain);
+        return f;
+    }
+
+    /**
+     * Submits a callable like submit() with a priority from 0, the default and lowest, to
+     * priority_levels - 1. Higher priority tasks are taken from the queue first, and waiting tasks
+     * gain priority over time. The priority is ignored unless the executor was constructed with
+     * QueueDiscipline::PRIORITY_LANES.
+     */
+    template<typename Callable, typename ... Args>
+    auto submit_with_priority(int priority, Callable&& c, Args&&... args)
+    -> std::future<decltype(conc11::invoke(std::forward<Callable>(c),
+            std::forward<Args>(args)...))> {
+        using RetType = decltype(
+                conc11::invoke(std::forward<Callable>(c), std::forward<Args>(args)...));
+
+        if (shut.load()) {
+            throw(std::system_error(std::make_error_code(std::errc::permission_denied)));
         }
+        std::packaged_task<RetType()> task(
+                std::bind(std::forward<Callable>(c), std::forward<Args>(args)...));
+        std::future<RetType> f = task.get_future();
+        UniqueTask t(std::move(task));
+        stamp_task(t);
+        enqueue_shared_task(std::move(t), ANY_DOMAIN, [priority](TaskQueue& q, UniqueTask&& t) {
+            q.push_with_priority(std::move(t), priority);
+        });
+        return f;
+    }
+
+    /**
+     * Submits a callable like submit() with a deadline. Tasks with earlier deadlines are taken
+     * from the queue first. The deadline is ignored unless the executor was constructed with
+     * QueueDiscipline::EARLIEST_DEADLINE_FIRST.
+     */
+    template<typename Clock, typename Duration, typename Callable, typename ... Args>
+    auto submit_with_deadline(const std::chrono::time_point<Clock, Duration>& deadline,
+                              Callable&& c, Args&&... args)
+    -> std::future<decltype(conc11::invoke(std::forward<Callable>(c),
+            std::forward<Args>(args)...))> {
+        using RetType = decltype(
+                conc11::invoke(std::forward<Callable>(c), std::forward<Args>(args)...));
+
+        if (shut.load()) {
+            throw(std::system_error(std::make_error_code(std::errc::permission_denied)));
+        }
+        auto steady_deadline = to_steady_time(deadline);
+        std::packaged_task<RetType()> task(
+                std::bind(std::forward<Callable>(c), std::forward<Args>(args)...));
+        std::future<RetType> f = task.get_future();
+        UniqueTask t(std::move(task));
+        stamp_task(t);
+        enqueue_shared_task(std::move(t), ANY_DOMAIN,
+                [steady_deadline](TaskQueue& q, UniqueTask&& t) {
+                    q.push_with_deadline(std::move(t), steady_deadline);
+                });
+        return f;
+    }
+
+    /**
+     * Submits a callable and its parameters like submit(), but returns a conc11::Future instead
+     * of a std::future. Continuations may be attached to the returned future with then(), which
+     * are scheduled onto an executor when the result arrives rather than blocking a thread.
+     */
+    template<typename Callable, typename ... Args>
+    auto async(Callable&& c, Args&&... args)
+    -> Future<decltype(conc11::invoke(std::forward<Callable>(c), std::forward<Args>(args)...))> {
+        using RetType = decltype(
+                conc11::invoke(std::forward<Callable>(c), std::forward<Args>(args)...));
+
+        if (shut.load()) {
+            throw(std::system_error(std::make_error_code(std::errc::permission_denied)));
+        }
+        Promise<RetType> promise;
+        Future<RetType> f = promise.get_future();
+        auto bind_obj = std::bind(std::forward<Callable>(c), std::forward<Args>(args)...);
+        enqueue_task(UniqueTask(PromiseTask<RetType, decltype(bind_obj)>(std::move(promise),
+                std::move(bind_obj))));
         return f;
     }
 
@@ -128,21 +372,221 @@ public:
      */
     template<typename Callable, typename ... Args>
     void execute(Callable&& c, Args&&... args) {
+        execute_on(ANY_DOMAIN, std::forward<Callable>(c), std::forward<Args>(args)...);
+    }
+
+    /**
+     * Executes a callable like execute() in a placement domain, see submit_on().
+     */
+    template<typename Callable, typename ... Args>
+    void execute_on(size_t domain, Callable&& c, Args&&... args) {
         if (shut.load()) {
             throw(std::system_error(std::make_error_code(std::errc::permission_denied)));
         }
         auto bind_obj = std::bind(std::forward<Callable>(c), std::forward<Args>(args)...);
-        auto uptr_task = conc11::make_unique<UntrackableTask<decltype(bind_obj)>>(
-                std::move(bind_obj));
-        {
-            std::lock_guard<std::mutex> lock(main_lock);
-            insert_task_locked(std::move(uptr_task));
+        enqueue_task(UniqueTask(UntrackableTask<decltype(bind_obj)>(std::move(bind_obj))),
+                domain);
+    }
+
+    /**
+     * Register a tenant sharing the workers with the others in proportion to weight, at least
+     * 1, while several tenants have queued tasks. Returns the tenant to pass to submit_as() and
+     * execute_as(). Tasks submitted without a tenant belong to DEFAULT_TENANT of weight 1.
+     * See TaskQueue for how the shares are kept. Tenants cannot be removed.
+     */
+    size_t add_tenant(const std::string& name, unsigned weight = 1) {
+        std::lock_guard<std::mutex> lock(main_lock);
+        tenants.emplace_back(new Tenant(name, weight > 0 ? weight : 1));
+        for (const auto& q : task_queues) {
+            q->add_tenant(tenants.back()->weight, &tenants.back()->usage);
         }
+        tenant_count.store(tenants.size(), std::memory_order_release);
+        return tenants.size() - 1;
+    }
+
+    /**
+     * Submits a callable like submit() on behalf of a tenant. Tasks of a tenant always go
+     * through the shared queues, also when submitted from a worker in WORK_STEALING mode.
+     */
+    template<typename Callable, typename ... Args>
+    auto submit_as(size_t tenant, Callable&& c, Args&&... args)
+    -> std::future<decltype(conc11::invoke(std::forward<Callable>(c),
+            std::forward<Args>(args)...))> {
+        using RetType = decltype(
+                conc11::invoke(std::forward<Callable>(c), std::forward<Args>(args)...));
+
+        check_tenant(tenant);
+        std::packaged_task<RetType()> task(
+                std::bind(std::forward<Callable>(c), std::forward<Args>(args)...));
+        std::future<RetType> f = task.get_future();
+        enqueue_tenant_task(UniqueTask(std::move(task)), tenant);
+        return f;
+    }
+
+    /**
+     * Executes a callable like execute() on behalf of a tenant, see submit_as().
+     */
+    template<typename Callable, typename ... Args>
+    void execute_as(size_t tenant, Callable&& c, Args&&... args) {
+        check_tenant(tenant);
+        auto bind_obj = std::bind(std::forward<Callable>(c), std::forward<Args>(args)...);
+        enqueue_tenant_task(UniqueTask(UntrackableTask<decltype(bind_obj)>(std::move(bind_obj))),
+                tenant);
+    }
+
+    /**
+     * Submits every callable in [first, last) like execute(), taking the executor lock once and
+     * waking only as many idle workers as there are tasks. Callables are copied from the range,
+     * wrap the iterators with std::make_move_iterator to move them instead.
+     */
+    template<class InputIt>
+    void execute_bulk(InputIt first, InputIt last) {
+        if (shut.load()) {
+            throw(std::system_error(std::make_error_code(std::errc::permission_denied)));
+        }
+        std::vector<UniqueTask> tasks;
+        for (; first != last; ++first) {
+            auto bind_obj = std::bind(*first);
+            tasks.emplace_back(UntrackableTask<decltype(bind_obj)>(std::move(bind_obj)));
+        }
+        enqueue_tasks(tasks);
+    }
+
+    template<class Range>
+    void execute_bulk(Range&& range) {
+        execute_bulk(std::begin(range), std::end(range));
+    }
+
+    /**
+     * Executes c(i) for every i in [0, count) like execute_bulk(). The callable is copied into
+     * each task.
+     */
+    template<class Callable>
+    void execute_n(size_t count, const Callable& c) {
+        if (shut.load()) {
+            throw(std::system_error(std::make_error_code(std::errc::permission_denied)));
+        }
+        std::vector<UniqueTask> tasks;
+        tasks.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            auto bind_obj = std::bind(c, i);
+            tasks.emplace_back(UntrackableTask<decltype(bind_obj)>(std::move(bind_obj)));
+        }
+        enqueue_tasks(tasks);
+    }
+
+    /**
+     * Submits every callable in [first, last) like submit(), taking the executor lock once.
+     * Returns the futures in the order of the range.
+     */
+    template<class InputIt>
+    auto submit_bulk(InputIt first, InputIt last)
+    -> std::vector<std::future<decltype(conc11::invoke(*first))>> {
+        using RetType = decltype(conc11::invoke(*first));
+
+        if (shut.load()) {
+            throw(std::system_error(std::make_error_code(std::errc::permission_denied)));
+        }
+        std::vector<std::future<RetType>> futures;
+        std::vector<UniqueTask> tasks;
+        for (; first != last; ++first) {
+            std::packaged_task<RetType()> task(std::bind(*first));
+            futures.emplace_back(task.get_future());
+            tasks.emplace_back(std::move(task));
+        }
+        enqueue_tasks(tasks);
+        return futures;
+    }
+
+    template<class Range>
+    auto submit_bulk(Range&& range)
+    -> decltype(this->submit_bulk(std::begin(range), std::end(range))) {
+        return submit_bulk(std::begin(range), std::end(range));
+    }
+
+    /**
+     * Wait for and return the result of a std::future, std::shared_future or conc11::Future
+     * like f.get(). Called from a worker of this executor, the worker runs queued tasks while
+     * the result is pending, starting with its own deque in WORK_STEALING mode, which likely
+     * holds the awaited task itself. Tasks that wait for their children this way do not tie up
+     * a worker each, so recursive fork/join code runs on a fixed pool without deadlocking or
+     * growing a cached pool. The result is checked between tasks, so a long helped task delays
+     * the return. Called from any other thread, it simply waits.
+     */
+    template<class FutureType>
+    auto join(FutureType& f) -> decltype(f.get()) {
+        if (is_current_worker()) {
+            help_until([&f]() {
+                return detail::future_is_ready(f);
+            }, [&f](std::chrono::microseconds timeout) {
+                f.wait_for(timeout);
+            });
+        }
+        return f.get();
+    }
+
+    /**
+     * Return once ready() is true, like join() for other kinds of events. wait_for(timeout)
+     * shall block until the event may have happened or the std::chrono::microseconds timeout
+     * passed. Called from a worker of this executor, queued tasks are run while waiting.
+     */
+    template<class Ready, class WaitFor>
+    void help_until(Ready ready, WaitFor wait_for) {
+        Worker* w = current_worker();
+        if (!w || &w->get_executor() != this) {
+            while (!ready()) {
+                wait_for(std::chrono::microseconds(std::chrono::seconds(1)));
+            }
+            return;
+        }
+        const std::chrono::microseconds max_wait(1000);
+        std::chrono::microseconds wait(10);
+        while (!ready()) {
+            if (w->help_once()) {
+                wait = std::chrono::microseconds(10);
+                continue;
+            }
+            // Nothing to run. Tasks queued meanwhile are noticed after the wait, which grows
+            // while the queues stay empty.
+            wait_for(wait);
+            wait = std::min(wait * 2, max_wait);
+        }
+    }
+
+    /**
+     * Returns true if called from a worker thread of this executor.
+     */
+    bool is_current_worker() noexcept {
+        Worker* w = current_worker();
+        return w && &w->get_executor() == this;
+    }
+
+    /**
+     * Invoke c with args in the calling thread and return its result, hinting that the call may
+     * block, on I/O for example. Called from a worker of this executor, this starts a compensating
+     * non-core worker if fewer than core_pool_size workers would be left outside blocking
+     * sections, up to max_pool_size, so that queued tasks keep running during the call. Once the
+     * call returns or throws, one non-core worker is asked to exit when it next looks for a task,
+     * returning the pool to its previous size. From any other thread, c is just invoked.
+     */
+    template<typename Callable, typename ... Args>
+    auto blocking_section(Callable&& c, Args&&... args)
+    -> decltype(conc11::invoke(std::forward<Callable>(c), std::forward<Args>(args)...)) {
+        if (!is_current_worker()) {
+            return conc11::invoke(std::forward<Callable>(c), std::forward<Args>(args)...);
+        }
+        bool compensated = begin_blocking();
+        ScopeGuard guard = make_scope_guard([this, compensated]() {
+            end_blocking(compensated);
+        });
+        return conc11::invoke(std::forward<Callable>(c), std::forward<Args>(args)...);
     }
 
     void shutdown() noexcept {
         std::lock_guard<std::mutex> lock(main_lock);
         shut.store(true);
+        not_full_cv.notify_all();
+        sizing_cv.notify_all();
         if (is_terminated_locked()) {
             wait_cv.notify_all();
         } else {
@@ -177,7 +621,7 @@ public:
         if (is_terminated_locked()) {
             return true;
         }
-        return wait_cv.wait_until(lock, timeout_time, [this](){return is_terminated();});
+        return wait_cv.wait_until(lock, timeout_time, [this](){return is_terminated_locked();});
     }
 
     /**
@@ -195,6 +639,89 @@ public:
         return active_count.load();
     }
 
+    /**
+     * Return number of tasks in the shared queues.
+     */
+    size_t get_queue_size() noexcept {
+        std::lock_guard<std::mutex> lock(main_lock);
+        return queued_count_locked();
+    }
+
+    /**
+     * Return number of placement domains, 1 without placement.
+     */
+    size_t get_domain_count() const noexcept {
+        return task_queues.size();
+    }
+
+    /**
+     * Return number of submissions refused by a full queue: thrown, timed out or run by the
+     * caller.
+     */
+    size_t get_rejected_count() noexcept {
+        return rejected_count.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Return number of queued tasks dropped by RejectionPolicy::DISCARD_OLDEST.
+     */
+    size_t get_discarded_count() noexcept {
+        return discarded_count.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Return number of submissions that blocked on a full queue.
+     */
+    size_t get_blocked_count() noexcept {
+        return blocked_count.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns a snapshot of the metrics collected since construction. All zero unless
+     * constructed with enable_metrics, except for thread counts and peak queue depth.
+     */
+    ExecutorMetrics get_metrics() {
+        ExecutorMetrics metrics;
+        std::lock_guard<std::mutex> lock(main_lock);
+        retired_counters.add_to(&metrics);
+        for (const auto& worker : workers) {
+            const detail::WorkerCounters* counters = worker->get_counters();
+            if (counters) {
+                counters->add_to(&metrics);
+                metrics.workers.push_back(WorkerMetrics{worker->get_id(),
+                        counters->executed.load(std::memory_order_relaxed),
+                        counters->stolen.load(std::memory_order_relaxed),
+                        std::chrono::nanoseconds(
+                                counters->idle_nanoseconds.load(std::memory_order_relaxed))});
+            }
+        }
+        metrics.threads_spawned = threads_spawned;
+        metrics.threads_retired = threads_retired;
+        metrics.peak_queue_depth = peak_queue_depth.load(std::memory_order_relaxed);
+        return metrics;
+    }
+
+    /**
+     * Returns a snapshot of the counters of every tenant, indexed by tenant.
+     */
+    std::vector<TenantMetrics> get_tenant_metrics() {
+        std::vector<TenantMetrics> metrics;
+        std::lock_guard<std::mutex> lock(main_lock);
+        for (size_t i = 0; i < tenants.size(); ++i) {
+            const Tenant& tenant = *tenants[i];
+            TenantMetrics m{tenant.name, tenant.weight, 0, 0,
+                    tenant.usage.completed.load(std::memory_order_relaxed),
+                    std::chrono::nanoseconds(
+                            tenant.usage.run_nanoseconds.load(std::memory_order_relaxed))};
+            for (const auto& q : task_queues) {
+                m.queued += q->get_tenant_size(i);
+                m.dispatched += q->get_tenant_dispatched(i);
+            }
+            metrics.push_back(std::move(m));
+        }
+        return metrics;
+    }
+
     bool is_shutdown() {
         return shut.load();
     }
@@ -214,9 +741,15 @@ private:
      */
     class Worker {
     public:
-        Worker(ThreadPoolExecutor& executor, bool core, size_t worker_index, int id) noexcept:
-        exec(executor), core(core), worker_index(worker_index),
-        id(id), worker_thread(std::ref(*this)) {
+        Worker(ThreadPoolExecutor& executor, bool core, size_t worker_index, int id,
+               size_t domain, std::vector<int> cpus):
+        exec(executor), core(core), worker_index(worker_index), steal_cursor(worker_index),
+        id(id), domain(domain), cpus(std::move(cpus)),
+        local_queue(executor.options.scheduling_mode == SchedulingMode::WORK_STEALING ?
+                new WorkStealingDeque<UniqueTask>(
+                        executor.options.local_queue_capacity) : nullptr),
+        counters(executor.options.enable_metrics ? new detail::WorkerCounters() : nullptr),
+        worker_thread(std::ref(*this)) {
         }
         Worker(const Worker&) = delete;
         Worker& operator=(const Worker&) = delete;
@@ -236,39 +769,232 @@ private:
             return id;
         }
 
+        ThreadPoolExecutor& get_executor() {
+            return exec;
+        }
+
+        WorkStealingDeque<UniqueTask>* get_local_queue() {
+            return local_queue.get();
+        }
+
+        const detail::WorkerCounters* get_counters() {
+            return counters.get();
+        }
+
+        size_t get_domain() {
+            return domain;
+        }
+
+        const std::vector<int>& get_cpus() {
+            return cpus;
+        }
+
+        /**
+         * Run one pending task from the local deque, the shared queues or a peer on behalf of
+         * a task of this worker waiting in join(). Returns false if there was none.
+         */
+        bool help_once() {
+            UniqueTask task;
+            TenantUsage* usage = nullptr;
+            if ((!local_queue || !local_queue->pop(&task)) &&
+                    (!exec.ring || !exec.ring->try_pop(&task))) {
+                std::lock_guard<std::mutex> lock(exec.main_lock);
+                if (!take_from_injection_queue_locked(&task) && !steal_locked(&task)) {
+                    return false;
+                }
+                usage = take_usage();
+            }
+            run_task(task, usage);
+            return true;
+        }
+
     private:
 
         /**
-         * Fetch ont task from task queue.
+         * Fetch one task from the shared queue, or steal one from a peer in WORK_STEALING mode.
          * Returns empty pointer when calling worker is non-core and timed out, or the executor
-         * is shut down when waiting
+         * is shut down and there is nothing left to fetch.
          */
-        std::unique_ptr<TaskBase> fetch_task_locked(std::unique_lock<std::mutex>& lock) {
-            // Fetch if queue not empty
-            if (!exec.task_queue.empty()) {
-                std::unique_ptr<TaskBase> t(std::move(exec.task_queue.front()));
-                exec.task_queue.pop();
-                return t;
-            }
-            // Wait until queue not empty, executor shut down or timed out
-            if (core) {
-                exec.cv.wait(lock,
-                        [this]() {return !exec.task_queue.empty() || exec.shut.load();});
-            } else {
-                auto timeout_time = std::chrono::steady_clock::now() + exec.timeout_nanoseconds;
-                exec.cv.wait_until(lock, timeout_time,
-                        [this]() {return !exec.task_queue.empty() || exec.shut.load();});
-            }
-            // Fetch if queue not empty, otherwise return nullptr
-            if (!exec.task_queue.empty()) {
-                std::unique_ptr<TaskBase> t(std::move(exec.task_queue.front()));
-                exec.task_queue.pop();
-                return t;
-            } else {
-                return std::unique_ptr<TaskBase>();
+        UniqueTask fetch_task_locked(std::unique_lock<std::mutex>& lock) {
+            auto timeout_time = std::chrono::steady_clock::now() + exec.timeout_nanoseconds;
+            auto has_work = [this]() {
+                return exec.has_queued_task_locked() || exec.shut.load() ||
+                        exec.has_stealable_task_locked() || should_retire_locked();
+            };
+            bool spun = false;
+            while (true) {
+                UniqueTask t;
+                if (should_retire_locked()) {
+                    --exec.retire_requests;
+                    return t;
+                }
+                if (take_from_injection_queue_locked(&t) || steal_locked(&t)) {
+                    return t;
+                }
+                if (exec.shut.load()) {
+                    return t;
+                }
+                int64_t idle_start = counters ? detail::metrics_clock() : 0;
+                if (!spun) {
+                    spun = true;
+                    if (spin_for_work(lock)) {
+                        add_idle_time(idle_start);
+                        continue;
+                    }
+                }
+                // Wait until there is work, executor shut down or timed out. Workers pushing to
+                // their own deques check idle_count after the push, so announce ourselves before
+                // checking for stealable tasks in has_work.
+                exec.idle_count.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                bool ready = true;
+                if (core || exec.options.adaptive_sizing) {
+                    exec.cv.wait(lock, has_work);
+                } else {
+                    ready = exec.cv.wait_until(lock, timeout_time, has_work);
+                }
+                exec.idle_count.fetch_sub(1);
+                add_idle_time(idle_start);
+                if (!ready) {
+                    return t;
+                }
+            }
+        }
+
+        /**
+         * Returns true if this worker shall exit to undo a compensation, see blocking_section.
+         */
+        bool should_retire_locked() {
+            return !core && exec.retire_requests > 0;
+        }
+
+        void add_idle_time(int64_t idle_start) {
+            if (counters) {
+                detail::add_single_writer(counters->idle_nanoseconds,
+                        static_cast<uint64_t>(detail::metrics_clock() - idle_start));
             }
         }
 
+        /**
+         * Poll for new work with the lock released, as configured by idle_spin_count and
+         * idle_yield_count. Returns true if a task may have been queued or the executor was
+         * shut down, false if nothing happened.
+         * While spinning_count covers a queued task, submitters do not notify, which is safe as
+         * spinners check the queue under the lock again before blocking. Workers pushing to
+         * their own deques bump work_epoch after seeing spinning_count, so as with idle_count,
+         * announce ourselves before checking for stealable tasks.
+         */
+        bool spin_for_work(std::unique_lock<std::mutex>& lock) {
+            size_t spins = exec.options.idle_spin_count;
+            size_t total = spins + exec.options.idle_yield_count;
+            if (total == 0) {
+                return false;
+            }
+            exec.spinning_count.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint64_t epoch = exec.work_epoch.load();
+            if (exec.has_stealable_task_locked()) {
+                exec.spinning_count.fetch_sub(1);
+                return true;
+            }
+            lock.unlock();
+            bool found = false;
+            for (size_t i = 0; i < total; ++i) {
+                if (exec.work_epoch.load(std::memory_order_relaxed) != epoch ||
+                        exec.shut.load(std::memory_order_relaxed)) {
+                    found = true;
+                    break;
+                }
+                if (i < spins) {
+                    cpu_relax();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            lock.lock();
+            exec.spinning_count.fetch_sub(1);
+            return found;
+        }
+
+        /**
+         * Take one task from the shared queue of this worker's domain, or failing that of the
+         * next domain that has one. In WORK_STEALING mode also move a batch of the following
+         * tasks of the own domain into the local deque, so that tasks submitted from outside the
+         * pool do not cost one lock acquisition each.
+         */
+        bool take_from_injection_queue_locked(UniqueTask* t) {
+            if (exec.ring && exec.ring->try_pop(t)) {
+                return true;
+            }
+            size_t n = exec.task_queues.size();
+            size_t i = 0;
+            while (i < n && exec.task_queues[(domain + i) % n]->empty()) {
+                ++i;
+            }
+            if (i == n) {
+                return false;
+            }
+            TaskQueue& queue = *exec.task_queues[(domain + i) % n];
+            size_t tenant = 0;
+            *t = queue.pop(&tenant);
+            if (queue.get_tenant_count() > 1) {
+                taken_usage = &exec.tenants[tenant]->usage;
+            }
+            int64_t now = exec.options.adaptive_sizing ? detail::metrics_clock() : 0;
+            exec.record_dequeue_locked(*t, now);
+            if (exec.waiting_submitters > 0) {
+                exec.not_full_cv.notify_all();
+            }
+            // Tasks in the local deque run in deque order, so only batch plain FIFO tasks of a
+            // single tenant. Leave tasks of other domains for their own workers.
+            if (local_queue && i == 0 && queue.get_discipline() == QueueDiscipline::FIFO &&
+                    queue.get_tenant_count() == 1) {
+                size_t batch = queue.size() / exec.workers.size();
+                size_t limit = local_queue->capacity() / 2;
+                if (batch > limit) {
+                    batch = limit;
+                }
+                for (; batch > 0; --batch) {
+                    exec.record_dequeue_locked(queue.front(), now);
+                    if (!local_queue->push(std::move(queue.front()))) {
+                        break;
+                    }
+                    queue.pop();
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Steal one task from peer workers, starting from where the last steal left off. Peers
+         * of the same domain are tried before those of other domains.
+         * Holding the main lock keeps the worker list stable during the scan.
+         */
+        bool steal_locked(UniqueTask* t) {
+            if (!local_queue) {
+                return false;
+            }
+            size_t n = exec.workers.size();
+            size_t passes = exec.task_queues.size() > 1 ? 2 : 1;
+            for (size_t pass = 0; pass < passes; ++pass) {
+                for (size_t i = 0; i < n; ++i) {
+                    Worker& victim = *exec.workers[(steal_cursor + i) % n];
+                    bool same_domain = victim.domain == domain;
+                    if (&victim == this || (passes > 1 && same_domain != (pass == 0))) {
+                        continue;
+                    }
+                    if (victim.local_queue->steal(t)) {
+                        steal_cursor = (steal_cursor + i) % n;
+                        if (counters) {
+                            detail::add_single_writer(counters->stolen, 1);
+                        }
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
         /**
          * Remove self by swapping state with last element in the worker array and decrease size.
          * Assumes the thread associated with this Worker instance owns the main lock.
@@ -276,37 +1002,86 @@ private:
         void remove_self_locked() {
             std::swap(exec.workers[worker_index], exec.workers.back());
             exec.workers[worker_index]->worker_index = worker_index;
+            if (counters) {
+                exec.retired_counters.merge(*counters);
+            }
+            ++exec.threads_retired;
             exec.dead_workers.emplace_back(std::move(exec.workers.back()));
             exec.workers.pop_back();
         }
 
         void run() {
             // There is a small period where worker_thread seen in the new thread is invalid.
+            current_worker() = this;
+            if (!cpus.empty()) {
+                set_current_thread_affinity(cpus);
+            }
+            std::unique_lock<std::mutex> lock(exec.main_lock, std::defer_lock);
             while (true) { // Worker main loop
-                std::unique_lock<std::mutex> lock(exec.main_lock);
-                if (exec.shut.load() && exec.task_queue.empty()) {
-                    break;
-                }
-                std::unique_ptr<TaskBase> task = fetch_task_locked(lock);
-                if (!task) {
-                    break;
+                UniqueTask task;
+                TenantUsage* usage = nullptr;
+                if ((local_queue && local_queue->pop(&task)) ||
+                        (exec.ring && exec.ring->try_pop(&task))) {
+                    ++exec.active_count;
+                } else {
+                    lock.lock();
+                    exec.reap_dead_workers_locked();
+                    task = fetch_task_locked(lock);
+                    if (!task) {
+                        break;
+                    }
+                    usage = take_usage();
+                    ++exec.active_count;
+                    lock.unlock();
                 }
-                ++exec.active_count;
-                lock.unlock();
-                (*task)();
-//                task.reset();
-                lock.lock();
-                exec.reap_dead_workers_locked();
+                run_task(task, usage);
+                task.reset();
                 --exec.active_count;
             }
-            {
-                // handle thread exit
-                std::lock_guard<std::mutex> lock(exec.main_lock);
-                remove_self_locked();
-                if (exec.is_terminated_locked()) {
-                    // Last worker exit after shutdown, finalize executor and notify all waiters
-                    exec.wait_cv.notify_all();
-                }
+            // handle thread exit, main lock is held here
+            current_worker() = nullptr;
+            remove_self_locked();
+            if (exec.is_terminated_locked()) {
+                // Last worker exit after shutdown, finalize executor and notify all waiters
+                exec.wait_cv.notify_all();
+            }
+        }
+
+        /**
+         * The usage to charge the task just taken from the shared queues with, nullptr unless
+         * the executor has several tenants.
+         */
+        TenantUsage* take_usage() {
+            TenantUsage* usage = taken_usage;
+            taken_usage = nullptr;
+            return usage;
+        }
+
+        void run_task(UniqueTask& task, TenantUsage* usage = nullptr) {
+            if (counters || usage) {
+                run_measured(task, usage);
+            } else {
+                task();
+            }
+        }
+
+        /**
+         * Run a task, recording its queue wait and run time in the metrics and its run time in
+         * the usage of its tenant. Tasks never throw as they are wrapped to catch exceptions.
+         */
+        void run_measured(UniqueTask& task, TenantUsage* usage) {
+            int64_t start = detail::metrics_clock();
+            if (counters) {
+                counters->queue_wait.record(start - task.get_stamp());
+            }
+            task();
+            int64_t run_time = detail::metrics_clock() - start;
+            if (counters) {
+                counters->run_time.record(run_time);
+                detail::add_single_writer(counters->executed, 1);
+            }
+            if (usage) {
+                usage->record(static_cast<uint64_t>(run_time));
             }
         }
 
@@ -316,27 +1091,519 @@ private:
         bool core = false;
         // Index of this worker instance in the worker list.
         size_t worker_index = 0;
-        // Instance of std::thread corresponding to this
+        // Index of the worker to try first when stealing.
+        size_t steal_cursor = 0;
         int id;
+        // Placement domain of this worker, 0 without placement.
+        size_t domain;
+        // CPUs this worker is pinned to, empty if not pinned.
+        std::vector<int> cpus;
+        // Deque of tasks submitted by this worker, only used in WORK_STEALING mode.
+        std::unique_ptr<WorkStealingDeque<UniqueTask>> local_queue;
+        // Metrics of this worker, only present if enabled.
+        std::unique_ptr<detail::WorkerCounters> counters;
+        // Usage of the tenant of the task last taken from the shared queues, see take_usage().
+        TenantUsage* taken_usage = nullptr;
+        // Instance of std::thread corresponding to this
         std::thread worker_thread;
     };
 
-    void insert_task_locked(std::unique_ptr<TaskBase>&& task) {
-        task_queue.emplace(std::move(task));
+    template<class Clock, class Duration>
+    static std::chrono::steady_clock::time_point to_steady_time(
+            const std::chrono::time_point<Clock, Duration>& t) {
+        return std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(t - Clock::now());
+    }
+
+    static std::chrono::steady_clock::time_point to_steady_time(
+            const std::chrono::steady_clock::time_point& t) {
+        return t;
+    }
+
+    /**
+     * The worker owned by calling thread, or nullptr if not called from a worker thread.
+     */
+    static Worker*& current_worker() noexcept {
+        static thread_local Worker* worker = nullptr;
+        return worker;
+    }
+
+    /**
+     * Record the submission time of a task for the queue wait histogram and adaptive sizing.
+     */
+    void stamp_task(UniqueTask& task) {
+        if (options.enable_metrics || options.adaptive_sizing) {
+            task.set_stamp(detail::metrics_clock());
+        }
+    }
+
+    /**
+     * Account a task taken from the shared queues at time now for adaptive sizing.
+     */
+    void record_dequeue_locked(const UniqueTask& task, int64_t now) {
+        if (options.adaptive_sizing) {
+            ++sizing_taken;
+            sizing_wait_nanoseconds += static_cast<uint64_t>(std::max<int64_t>(0,
+                    now - task.get_stamp()));
+        }
+    }
+
+    /**
+     * Body of the adaptive sizing controller thread, see ThreadPoolOptions::adaptive_sizing.
+     * Workers are started with the lock held, as a worker may exit and be joined as soon as it
+     * can take the lock, but never by a submitting thread.
+     */
+    void run_sizing() {
+        std::unique_lock<std::mutex> lock(main_lock);
+        size_t grow_streak = 0;
+        size_t shrink_streak = 0;
+        // Tasks taken in the sample that triggered the last growth during the current overload
+        uint64_t throughput_before_growth = 0;
+        const uint64_t target_wait = static_cast<uint64_t>(options.target_queue_wait.count());
+        auto last_resize = std::chrono::steady_clock::now() - options.min_resize_interval;
+        while (!is_terminated_locked()) {
+            sizing_cv.wait_for(lock, options.sizing_interval);
+            uint64_t taken = sizing_taken;
+            uint64_t wait = taken > 0 ? sizing_wait_nanoseconds / taken : 0;
+            sizing_taken = 0;
+            sizing_wait_nanoseconds = 0;
+            size_t queued = queued_count_locked();
+            size_t idle = workers.size() - active_count.load();
+            if (queued > 0 && workers.empty()) {
+                // Nobody would ever take the queued tasks
+                add_worker_locked(false);
+                continue;
+            }
+            if (shut.load()) {
+                continue;
+            }
+            bool overloaded = queued > 0 && idle == 0 && (taken == 0 || wait >= target_wait);
+            bool underloaded = queued == 0 && idle > 0;
+            grow_streak = overloaded ? grow_streak + 1 : 0;
+            shrink_streak = underloaded ? shrink_streak + 1 : 0;
+            if (!overloaded) {
+                throughput_before_growth = 0;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_resize < options.min_resize_interval) {
+                continue;
+            }
+            if (grow_streak >= options.grow_after_samples && workers.size() < max_pool_size) {
+                if (taken <= throughput_before_growth && taken > 0) {
+                    // The last growth did not help, the bottleneck is elsewhere
+                    continue;
+                }
+                throughput_before_growth = taken;
+                add_worker_locked(false);
+                grow_streak = 0;
+                last_resize = now;
+            } else if (shrink_streak >= options.shrink_after_samples &&
+                    workers.size() > core_pool_size + retire_requests) {
+                ++retire_requests;
+                cv.notify_all();
+                shrink_streak = 0;
+                last_resize = now;
+            }
+        }
+    }
+
+    void enqueue_task(UniqueTask&& task, size_t domain = ANY_DOMAIN) {
+        stamp_task(task);
+        if (options.scheduling_mode == SchedulingMode::WORK_STEALING) {
+            Worker* w = current_worker();
+            if (w && &w->get_executor() == this &&
+                    (domain == ANY_DOMAIN || domain % task_queues.size() == w->get_domain()) &&
+                    w->get_local_queue()->push(std::move(task))) {
+                notify_task_pushed();
+                return;
+            }
+        }
+        if (ring && domain == ANY_DOMAIN && tenant_count.load(std::memory_order_relaxed) == 1 &&
+                ring->try_push(std::move(task))) {
+            update_peak_queue_depth(ring->size());
+            notify_task_pushed();
+            return;
+        }
+        enqueue_shared_task(std::move(task), domain, [](TaskQueue& q, UniqueTask&& t) {
+            q.push(std::move(t));
+        });
+    }
+
+    void check_tenant(size_t tenant) {
+        if (shut.load()) {
+            throw(std::system_error(std::make_error_code(std::errc::permission_denied)));
+        }
+        if (tenant >= tenant_count.load(std::memory_order_acquire)) {
+            throw(std::system_error(std::make_error_code(std::errc::invalid_argument)));
+        }
+    }
+
+    void enqueue_tenant_task(UniqueTask&& task, size_t tenant) {
+        stamp_task(task);
+        enqueue_shared_task(std::move(task), ANY_DOMAIN, [tenant](TaskQueue& q, UniqueTask&& t) {
+            q.push(std::move(t), tenant);
+        });
+    }
+
+    /**
+     * Wake a worker for a task pushed to a worker deque or the lock-free queue without the lock.
+     * Pairs with the fences in fetch_task_locked and spin_for_work, see there.
+     */
+    void notify_task_pushed() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (spinning_count.load() > 0) {
+            work_epoch.fetch_add(1);
+        }
+        if (shut.load()) {
+            // shutdown() raced the push, and workers exit once they find nothing to do, so all
+            // may have gone. Start one as the locked path would.
+            std::lock_guard<std::mutex> lock(main_lock);
+            if (has_queued_task_locked()) {
+                notify_task_queued_locked();
+            }
+            return;
+        }
+        if (idle_count.load() > 0) {
+            std::lock_guard<std::mutex> lock(main_lock);
+            cv.notify_one();
+        }
+    }
+
+    /**
+     * Put a task into the shared queue of a domain with push, applying the rejection policy if
+     * the queues are full.
+     */
+    template<class Push>
+    void enqueue_shared_task(UniqueTask&& task, size_t domain, Push push) {
+        // Destroyed after the lock is released, see make_room_locked.
+        UniqueTask discarded;
+        {
+            std::unique_lock<std::mutex> lock(main_lock);
+            TaskQueue& queue = submission_queue_locked(domain);
+            if (make_room_locked(lock, queue, &discarded)) {
+                push(queue, std::move(task));
+                notify_task_queued_locked();
+                return;
+            }
+        }
+        task();
+    }
+
+    /**
+     * Enqueue a batch of tasks. Tasks are moved from, but the vector is left for the caller.
+     */
+    void enqueue_tasks(std::vector<UniqueTask>& tasks) {
+        if (options.enable_metrics || options.adaptive_sizing) {
+            int64_t now = detail::metrics_clock();
+            for (auto& task : tasks) {
+                task.set_stamp(now);
+            }
+        }
+        size_t begin = 0;
+        if (options.scheduling_mode == SchedulingMode::WORK_STEALING) {
+            Worker* w = current_worker();
+            if (w && &w->get_executor() == this) {
+                for (; begin < tasks.size(); ++begin) {
+                    if (!w->get_local_queue()->push(std::move(tasks[begin]))) {
+                        break;
+                    }
+                }
+                if (begin > 0) {
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (spinning_count.load() > 0) {
+                        work_epoch.fetch_add(1);
+                    }
+                    if (begin == tasks.size() && idle_count.load() == 0) {
+                        return;
+                    }
+                }
+            }
+        }
+        if (ring && tenant_count.load(std::memory_order_relaxed) == 1) {
+            // Announced with the rest below under the lock, which also starts a worker if
+            // shutdown() raced the push and all workers have exited
+            begin += ring->try_push_n(std::make_move_iterator(tasks.begin() + begin),
+                    std::make_move_iterator(tasks.end()));
+        }
+        std::vector<UniqueTask> discarded;
+        std::vector<UniqueTask> caller_runs;
+        std::unique_lock<std::mutex> lock(main_lock);
+        size_t queued = 0;
+        try {
+            for (size_t i = begin; i < tasks.size(); ++i) {
+                UniqueTask d;
+                TaskQueue& queue = submission_queue_locked(ANY_DOMAIN);
+                if (!make_room_locked(lock, queue, &d)) {
+                    caller_runs.emplace_back(std::move(tasks[i]));
+                    continue;
+                }
+                if (d) {
+                    discarded.emplace_back(std::move(d));
+                }
+                queue.push(std::move(tasks[i]));
+                ++queued;
+            }
+        } catch (...) {
+            // Rejected by a full queue, the tasks queued so far still have to run
+            notify_tasks_queued_locked(begin + queued);
+            throw;
+        }
+        // Tasks pushed to the local deque above are stealable, count them in
+        notify_tasks_queued_locked(begin + queued);
+        lock.unlock();
+        discarded.clear();
+        for (auto& task : caller_runs) {
+            task();
+        }
+    }
+
+    /**
+     * Wake workers for n tasks just put into the shared queue. Adds a worker if none is idle, as
+     * notify_task_queued_locked does for single tasks, so that a bulk submission grows the pool
+     * no more than submitting its tasks one by one, then wakes min(n, waiting) workers in one
+     * pass.
+     */
+    void notify_tasks_queued_locked(size_t n) {
+        update_peak_queue_depth_locked();
         size_t idle_workers = workers.size() - active_count.load();
-        if (idle_workers == 0 && workers.size() < max_pool_size) {
+        if (n > 0 && idle_workers == 0 && workers.size() < max_pool_size &&
+                !options.adaptive_sizing) {
             add_worker_locked(false);
         }
+        if (workers.empty()) {
+            // The sizing controller starts the first worker
+            sizing_cv.notify_one();
+        }
+        work_epoch.fetch_add(1, std::memory_order_relaxed);
+        // Spinning workers check the queue before blocking, only wake for the rest
+        size_t spinning = spinning_count.load();
+        n = n > spinning ? n - spinning : 0;
+        if (n == 0) {
+            return;
+        }
+        if (n >= idle_count.load()) {
+            cv.notify_all();
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                cv.notify_one();
+            }
+        }
+    }
+
+    /**
+     * Make room in bounded shared queues for one more task according to the rejection policy.
+     * The bound applies to all domains together. Returns false if the caller shall run the task
+     * itself. A task dropped from the queue is moved to discarded, to be destroyed by the caller
+     * after releasing the lock, as destroying a task may complete a promise whose continuation
+     * submits to this executor. DISCARD_OLDEST drops from the target queue if it has tasks.
+     */
+    bool make_room_locked(std::unique_lock<std::mutex>& lock, TaskQueue& target,
+                          UniqueTask* discarded) {
+        size_t max_size = options.max_queue_size;
+        if (max_size == 0 || queued_count_locked() < max_size) {
+            return true;
+        }
+        switch (options.rejection_policy) {
+        case RejectionPolicy::BLOCK: {
+            blocked_count.fetch_add(1, std::memory_order_relaxed);
+            // Tasks queued earlier by the same bulk submission have not been announced yet
+            if (workers.size() == active_count.load() && workers.size() < max_pool_size &&
+                    !options.adaptive_sizing) {
+                add_worker_locked(false);
+            }
+            cv.notify_all();
+            auto has_room = [this, max_size]() {
+                return queued_count_locked() < max_size || shut.load();
+            };
+            bool ready = true;
+            ++waiting_submitters;
+            if (options.block_timeout == std::chrono::nanoseconds::max()) {
+                not_full_cv.wait(lock, has_room);
+            } else {
+                ready = not_full_cv.wait_for(lock, options.block_timeout, has_room);
+            }
+            --waiting_submitters;
+            if (shut.load()) {
+                throw(std::system_error(std::make_error_code(std::errc::permission_denied)));
+            }
+            if (!ready) {
+                rejected_count.fetch_add(1, std::memory_order_relaxed);
+                throw(std::system_error(std::make_error_code(std::errc::timed_out)));
+            }
+            return true;
+        }
+        case RejectionPolicy::CALLER_RUNS:
+            rejected_count.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        case RejectionPolicy::DISCARD_OLDEST: {
+            discarded_count.fetch_add(1, std::memory_order_relaxed);
+            TaskQueue* victim = &target;
+            for (const auto& q : task_queues) {
+                if (victim->empty() && !q->empty()) {
+                    victim = q.get();
+                }
+            }
+            *discarded = victim->pop_least_urgent();
+            return true;
+        }
+        case RejectionPolicy::THROW:
+            break;
+        }
+        rejected_count.fetch_add(1, std::memory_order_relaxed);
+        throw(std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again)));
+    }
+
+    /**
+     * Wake a worker for a task just put into the shared queue, adding one if none is idle.
+     */
+    void notify_task_queued_locked() {
+        update_peak_queue_depth_locked();
+        size_t idle_workers = workers.size() - active_count.load();
+        if (idle_workers == 0 && workers.size() < max_pool_size && !options.adaptive_sizing) {
+            add_worker_locked(false);
+        } else if (workers.empty()) {
+            // The sizing controller starts the first worker
+            sizing_cv.notify_one();
+        }
+        work_epoch.fetch_add(1, std::memory_order_relaxed);
+        // A spinning worker will find the task when it checks the queue before blocking
+        if (spinning_count.load() >= queued_count_locked()) {
+            return;
+        }
         cv.notify_one();
     }
 
+    void update_peak_queue_depth_locked() {
+        update_peak_queue_depth(queued_count_locked());
+    }
+
+    /**
+     * Raise peak_queue_depth to depth. Lock-free for tasks pushed to the lock-free queue, which
+     * pass their depth alone, so tasks that overflowed to the shared queue count only in pushes
+     * made under the lock.
+     */
+    void update_peak_queue_depth(size_t depth) noexcept {
+        size_t peak = peak_queue_depth.load(std::memory_order_relaxed);
+        while (depth > peak && !peak_queue_depth.compare_exchange_weak(peak, depth,
+                std::memory_order_relaxed)) {
+        }
+    }
+
+    size_t queued_count_locked() const noexcept {
+        size_t n = ring ? ring->size() : 0;
+        for (const auto& q : task_queues) {
+            n += q->size();
+        }
+        return n;
+    }
+
+    bool has_queued_task_locked() const noexcept {
+        if (ring && !ring->empty()) {
+            return true;
+        }
+        for (const auto& q : task_queues) {
+            if (!q->empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * The shared queue a task submitted to domain goes to, see submit_on().
+     */
+    TaskQueue& submission_queue_locked(size_t domain) {
+        size_t n = task_queues.size();
+        if (n == 1) {
+            return *task_queues[0];
+        }
+        if (domain == ANY_DOMAIN) {
+            Worker* w = current_worker();
+            if (w && &w->get_executor() == this) {
+                domain = w->get_domain();
+            } else {
+                domain = next_domain++;
+            }
+        }
+        return *task_queues[domain % n];
+    }
+
+    /**
+     * Count a worker about to block and start a compensating worker if fewer than
+     * core_pool_size workers are left outside blocking sections. Returns true if one was started.
+     */
+    bool begin_blocking() {
+        std::lock_guard<std::mutex> lock(main_lock);
+        ++blocking_count;
+        if (shut.load() || workers.size() >= max_pool_size ||
+                workers.size() - blocking_count >= core_pool_size) {
+            return false;
+        }
+        add_worker_locked(false);
+        return true;
+    }
+
+    /**
+     * Ask a non-core worker to exit after a compensated blocking section, unless the pool has
+     * already shrunk back to its core workers, for example because of timeouts.
+     */
+    void end_blocking(bool compensated) {
+        std::lock_guard<std::mutex> lock(main_lock);
+        --blocking_count;
+        if (compensated && workers.size() > core_pool_size + retire_requests) {
+            ++retire_requests;
+            cv.notify_all();
+        }
+    }
+
     void add_worker_locked(bool core) {
+        ++threads_spawned;
         static int id = 1;
-        workers.emplace_back(new Worker(*this, core, workers.size(), id++));
+        size_t domain = 0;
+        std::vector<int> cpus;
+        const auto& domains = options.placement_domains;
+        if (!domains.empty()) {
+            // The domain with the fewest workers, and in it the CPU with the fewest pinned ones
+            std::vector<size_t> domain_load(domains.size());
+            for (const auto& worker : workers) {
+                ++domain_load[worker->get_domain()];
+            }
+            domain = std::min_element(domain_load.begin(), domain_load.end()) -
+                    domain_load.begin();
+            cpus = domains[domain];
+            if (options.pin_to_core && !cpus.empty()) {
+                std::vector<size_t> cpu_load(cpus.size());
+                for (const auto& worker : workers) {
+                    if (worker->get_domain() == domain && worker->get_cpus().size() == 1) {
+                        auto it = std::find(cpus.begin(), cpus.end(), worker->get_cpus()[0]);
+                        if (it != cpus.end()) {
+                            ++cpu_load[it - cpus.begin()];
+                        }
+                    }
+                }
+                int cpu = cpus[std::min_element(cpu_load.begin(), cpu_load.end()) -
+                        cpu_load.begin()];
+                cpus.assign(1, cpu);
+            }
+        }
+        workers.emplace_back(new Worker(*this, core, workers.size(), id++, domain,
+                std::move(cpus)));
+    }
+
+    bool has_stealable_task_locked() {
+        if (options.scheduling_mode != SchedulingMode::WORK_STEALING) {
+            return false;
+        }
+        for (const auto& worker : workers) {
+            if (!worker->get_local_queue()->empty()) {
+                return true;
+            }
+        }
+        return false;
     }
 
     bool is_terminated_locked() {
-        return shut.load() && task_queue.empty() && workers.empty();
+        return shut.load() && !has_queued_task_locked() && workers.empty();
     }
 
     void reap_dead_workers_locked() {
@@ -352,8 +1619,27 @@ private:
     const size_t core_pool_size;
     const size_t max_pool_size;
     const std::chrono::nanoseconds timeout_nanoseconds;
+    const ThreadPoolOptions options;
 
-    std::queue<std::unique_ptr<TaskBase>> task_queue;
+    // Lock-free queue ahead of the shared queues, see ThreadPoolOptions::lock_free_queue_capacity
+    std::unique_ptr<MPMCQueue<UniqueTask>> ring;
+    // Shared queues, one per placement domain. Never resized after construction.
+    std::vector<std::unique_ptr<TaskQueue>> task_queues;
+    // Domain of the next task submitted from outside the pool without one, protected by main lock
+    size_t next_domain = 0;
+
+    struct Tenant {
+        Tenant(const std::string& name, unsigned weight) : name(name), weight(weight) {
+        }
+
+        const std::string name;
+        const unsigned weight;
+        TenantUsage usage;
+    };
+
+    // Tenants by index, never shrinks. Appended under main lock, tenant_count follows.
+    std::vector<std::unique_ptr<Tenant>> tenants;
+    std::atomic<size_t> tenant_count{1};
 
     std::vector<std::unique_ptr<Worker>> workers;
     std::vector<std::unique_ptr<Worker>> dead_workers;
@@ -361,8 +1647,37 @@ private:
     std::mutex main_lock;
     std::condition_variable cv;
     std::condition_variable wait_cv;
+    // Signalled when a bounded queue has room again
+    std::condition_variable not_full_cv;
     std::atomic<bool> shut;
     std::atomic<size_t> active_count;
+    // Number of workers blocked waiting for tasks
+    std::atomic<size_t> idle_count;
+    // Number of workers polling for tasks in spin_for_work
+    std::atomic<size_t> spinning_count;
+    // Bumped whenever a task is queued while workers may be spinning
+    std::atomic<uint64_t> work_epoch;
+    // Number of submitters blocked on a full queue, protected by main lock
+    size_t waiting_submitters;
+    // Number of non-core workers asked to exit after blocking sections, protected by main lock
+    size_t retire_requests = 0;
+    // Number of workers inside blocking sections, protected by main lock
+    size_t blocking_count = 0;
+    // Adaptive sizing, see run_sizing. Tasks taken from the shared queues since the last sample
+    // and their total queue wait, protected by main lock.
+    std::thread sizing_thread;
+    std::condition_variable sizing_cv;
+    uint64_t sizing_taken = 0;
+    uint64_t sizing_wait_nanoseconds = 0;
+    std::atomic<size_t> rejected_count;
+    std::atomic<size_t> discarded_count;
+    std::atomic<size_t> blocked_count;
+    // Metrics, protected by main lock
+    detail::WorkerCounters retired_counters;
+    uint64_t threads_spawned = 0;
+    uint64_t threads_retired = 0;
+    // Raised without the lock by tasks pushed to the lock-free queue
+    std::atomic<size_t> peak_queue_depth;
 };
 
 // Helper functions for constructing thread pools.
@@ -375,6 +1690,35 @@ std::unique_ptr<ThreadPoolExecutor> make_fixed_thread_pool(size_t num_threads) {
     return conc11::make_unique<ThreadPoolExecutor>(num_threads, num_threads, 0L);
 }
 
+std::unique_ptr<ThreadPoolExecutor> make_fixed_thread_pool(size_t num_threads,
+                                                           const ThreadPoolOptions& options) {
+    return conc11::make_unique<ThreadPoolExecutor>(num_threads, num_threads, 0L, options);
+}
+
+/**
+ * Construct a fixed size thread pool with threads_per_node workers on every NUMA node the
+ * process may run on, each restricted to the CPUs of its node, or to a single core if
+ * pin_to_core. Use submit_on() with the node index to run tasks near their data.
+ */
+std::unique_ptr<ThreadPoolExecutor> make_numa_thread_pool(size_t threads_per_node,
+                                                          bool pin_to_core = false) {
+    ThreadPoolOptions options;
+    options.placement_domains = CpuTopology::detect().get_nodes();
+    options.pin_to_core = pin_to_core;
+    size_t num_threads = threads_per_node * options.placement_domains.size();
+    return conc11::make_unique<ThreadPoolExecutor>(num_threads, num_threads, 0L, options);
+}
+
+/**
+ * Construct a fixed size thread pool in which every worker owns a work-stealing deque. Suits
+ * workloads where tasks submit further tasks, as in divide and conquer algorithms.
+ */
+std::unique_ptr<ThreadPoolExecutor> make_work_stealing_pool(size_t num_threads) {
+    ThreadPoolOptions options;
+    options.scheduling_mode = SchedulingMode::WORK_STEALING;
+    return conc11::make_unique<ThreadPoolExecutor>(num_threads, num_threads, 0L, options);
+}
+
 static const size_t MAX_CACHED_THREADS = 1024;
 
 std::unique_ptr<ThreadPoolExecutor> make_cached_thread_pool() {
@@ -0,0 +1,218 @@
+/**
+ * executor_metrics.h
+ */
+#ifndef CONCURRENCY_EXECUTOR_METRICS_H_
+#define CONCURRENCY_EXECUTOR_METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace conc11 {
+
+/**
+ * Snapshot of a histogram of nanosecond durations with power of two buckets. Bucket 0 counts
+ * zero durations and bucket i counts durations in [2^(i-1), 2^i) nanoseconds.
+ */
+struct HistogramSnapshot {
+    static const size_t BUCKETS = 64;
+
+    std::array<uint64_t, BUCKETS> buckets;
+
+    HistogramSnapshot() {
+        buckets.fill(0);
+    }
+
+    uint64_t count() const noexcept {
+        uint64_t n = 0;
+        for (uint64_t b : buckets) {
+            n += b;
+        }
+        return n;
+    }
+
+    /**
+     * Upper bound of the bucket holding the q quantile, 0 < q <= 1, e.g. 0.99 for p99.
+     * Returns 0 if the histogram is empty.
+     */
+    std::chrono::nanoseconds percentile(double q) const noexcept {
+        uint64_t n = count();
+        if (n == 0) {
+            return std::chrono::nanoseconds(0);
+        }
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(n));
+        if (rank == 0) {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                return i < 63 ? std::chrono::nanoseconds((static_cast<int64_t>(1) << i) - 1) :
+                        std::chrono::nanoseconds::max();
+            }
+        }
+        return std::chrono::nanoseconds::max();
+    }
+};
+
+/**
+ * Counters of one worker thread.
+ */
+struct WorkerMetrics {
+    int id;
+    // Tasks run by this worker
+    uint64_t executed;
+    // Tasks this worker stole from the deques of its peers in WORK_STEALING mode
+    uint64_t stolen;
+    // Time spent spinning or blocked waiting for tasks
+    std::chrono::nanoseconds idle_time;
+};
+
+/**
+ * Counters of one tenant of a ThreadPoolExecutor, see ThreadPoolExecutor::add_tenant().
+ */
+struct TenantMetrics {
+    std::string name;
+    unsigned weight;
+    // Tasks waiting in the shared queues
+    size_t queued;
+    // Tasks taken from the shared queues to run, not counting any dropped by DISCARD_OLDEST
+    uint64_t dispatched;
+    // Tasks run and their total run time, only recorded while there are several tenants
+    uint64_t completed;
+    std::chrono::nanoseconds run_time;
+};
+
+/**
+ * Snapshot of the metrics of a ThreadPoolExecutor constructed with enable_metrics.
+ * Totals include workers that have already exited.
+ */
+struct ExecutorMetrics {
+    // Time from submission until a worker takes the task
+    HistogramSnapshot queue_wait;
+    // Time spent running tasks
+    HistogramSnapshot run_time;
+    // Living workers
+    std::vector<WorkerMetrics> workers;
+    uint64_t executed = 0;
+    uint64_t stolen = 0;
+    std::chrono::nanoseconds idle_time = std::chrono::nanoseconds(0);
+    uint64_t threads_spawned = 0;
+    uint64_t threads_retired = 0;
+    // Largest size of the shared queue seen
+    size_t peak_queue_depth = 0;
+};
+
+namespace detail {
+
+inline int64_t metrics_clock() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Add to a relaxed atomic that has a single writer, which is cheaper than a locked fetch_add.
+ */
+inline void add_single_writer(std::atomic<uint64_t>& a, uint64_t n) noexcept {
+    a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/**
+ * Writer side of a HistogramSnapshot, written by one thread and read by any.
+ */
+class HistogramCounters {
+public:
+    HistogramCounters() {
+        for (auto& b : buckets) {
+            b.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    HistogramCounters(const HistogramCounters&) = delete;
+    HistogramCounters& operator=(const HistogramCounters&) = delete;
+
+    void record(int64_t nanoseconds) noexcept {
+        add_single_writer(buckets[bucket_of(nanoseconds)], 1);
+    }
+
+    /**
+     * Add the counts of other, which must not be written concurrently with this.
+     */
+    void merge(const HistogramCounters& other) noexcept {
+        for (size_t i = 0; i < HistogramSnapshot::BUCKETS; ++i) {
+            add_single_writer(buckets[i], other.buckets[i].load(std::memory_order_relaxed));
+        }
+    }
+
+    void add_to(HistogramSnapshot* snapshot) const noexcept {
+        for (size_t i = 0; i < HistogramSnapshot::BUCKETS; ++i) {
+            snapshot->buckets[i] += buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static size_t bucket_of(int64_t nanoseconds) noexcept {
+        if (nanoseconds <= 0) {
+            return 0;
+        }
+        uint64_t v = static_cast<uint64_t>(nanoseconds);
+#if defined(__GNUC__)
+        size_t bits = 64 - static_cast<size_t>(__builtin_clzll(v));
+#else
+        size_t bits = 0;
+        for (; v; v >>= 1) {
+            ++bits;
+        }
+#endif
+        return bits < HistogramSnapshot::BUCKETS ? bits : HistogramSnapshot::BUCKETS - 1;
+    }
+
+    std::array<std::atomic<uint64_t>, HistogramSnapshot::BUCKETS> buckets;
+};
+
+/**
+ * Counters owned by one worker. Only the worker thread writes them, except that the executor
+ * merges the counters of exited workers into a retired instance under its lock.
+ */
+struct WorkerCounters {
+    WorkerCounters() : executed(0), stolen(0), idle_nanoseconds(0) {
+    }
+
+    void merge(const WorkerCounters& other) noexcept {
+        add_single_writer(executed, other.executed.load(std::memory_order_relaxed));
+        add_single_writer(stolen, other.stolen.load(std::memory_order_relaxed));
+        add_single_writer(idle_nanoseconds,
+                other.idle_nanoseconds.load(std::memory_order_relaxed));
+        queue_wait.merge(other.queue_wait);
+        run_time.merge(other.run_time);
+    }
+
+    /**
+     * Add to the totals and histograms of a snapshot.
+     */
+    void add_to(ExecutorMetrics* metrics) const noexcept {
+        metrics->executed += executed.load(std::memory_order_relaxed);
+        metrics->stolen += stolen.load(std::memory_order_relaxed);
+        metrics->idle_time += std::chrono::nanoseconds(
+                idle_nanoseconds.load(std::memory_order_relaxed));
+        queue_wait.add_to(&metrics->queue_wait);
+        run_time.add_to(&metrics->run_time);
+    }
+
+    std::atomic<uint64_t> executed;
+    std::atomic<uint64_t> stolen;
+    std::atomic<uint64_t> idle_nanoseconds;
+    HistogramCounters queue_wait;
+    HistogramCounters run_time;
+};
+
+} // namespace detail
+
+} // namespace conc11
+
+#endif /* CONCURRENCY_EXECUTOR_METRICS_H_ */
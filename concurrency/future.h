@@ -0,0 +1,663 @@
+/**
+ * future.h
+ */
+#ifndef CONCURRENCY_FUTURE_H_
+#define CONCURRENCY_FUTURE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "../util/util.h"
+
+namespace conc11 {
+
+template<class T>
+class Future;
+
+template<class T>
+class Promise;
+
+namespace detail {
+
+struct Unit {
+};
+
+template<class T>
+struct FutureValueType {
+    using type = T;
+};
+
+template<>
+struct FutureValueType<void> {
+    using type = Unit;
+};
+
+/**
+ * Mutex and condition variable shared by all future states that hash to the same stripe. Keeping
+ * them out of the shared state keeps the state small, and they are touched only when a thread
+ * actually blocks waiting for a result.
+ */
+struct FutureWaitStripe {
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+inline FutureWaitStripe& future_wait_stripe(const void* state) {
+    static const std::size_t NUM_STRIPES = 64;
+    static FutureWaitStripe stripes[NUM_STRIPES];
+    std::uintptr_t h = reinterpret_cast<std::uintptr_t>(state);
+    return stripes[(h >> 6) % NUM_STRIPES];
+}
+
+/**
+ * Shared state between a Promise and its Future. Holds either a value or an exception, plus at
+ * most one continuation that is invoked when the state becomes ready.
+ */
+template<class T>
+class FutureState {
+public:
+    using ValueType = typename FutureValueType<T>::type;
+
+    FutureState() noexcept:status(PENDING), has_waiters(false), has_value(false) {
+    }
+
+    ~FutureState() {
+        if (has_value) {
+            value_ptr()->~ValueType();
+        }
+    }
+
+    FutureState(const FutureState&) = delete;
+    FutureState& operator=(const FutureState&) = delete;
+
+    template<class ... Args>
+    void set_value(Args&&... args) {
+        new (&storage) ValueType(std::forward<Args>(args)...);
+        has_value = true;
+        publish();
+    }
+
+    void set_exception(std::exception_ptr e) {
+        exception = e;
+        publish();
+    }
+
+    bool is_ready() const noexcept {
+        // Sequentially consistent, as waiters check it after setting has_waiters
+        return status.load() == READY;
+    }
+
+    void wait() {
+        if (is_ready()) {
+            return;
+        }
+        FutureWaitStripe& stripe = future_wait_stripe(this);
+        std::unique_lock<std::mutex> lock(stripe.mtx);
+        has_waiters.store(true);
+        stripe.cv.wait(lock, [this]() {return is_ready();});
+    }
+
+    template<class Clock, class Duration>
+    bool wait_until(const std::chrono::time_point<Clock, Duration>& timeout_time) {
+        if (is_ready()) {
+            return true;
+        }
+        FutureWaitStripe& stripe = future_wait_stripe(this);
+        std::unique_lock<std::mutex> lock(stripe.mtx);
+        has_waiters.store(true);
+        return stripe.cv.wait_until(lock, timeout_time, [this]() {return is_ready();});
+    }
+
+    /**
+     * Wait for the result and move it out, or rethrow the stored exception.
+     */
+    ValueType take() {
+        wait();
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*value_ptr());
+    }
+
+    /**
+     * Register a continuation to be invoked once when the state becomes ready, by the thread
+     * making it ready. If the state is already ready the continuation is invoked immediately by
+     * the calling thread. At most one continuation may be registered.
+     */
+    void set_continuation(UniqueTask&& c) {
+        continuation = std::move(c);
+        int expected = PENDING;
+        if (!status.compare_exchange_strong(expected, CONTINUATION_SET,
+                std::memory_order_acq_rel, std::memory_order_acquire)) {
+            UniqueTask t(std::move(continuation));
+            t();
+        }
+    }
+
+private:
+    static const int PENDING = 0;
+    static const int CONTINUATION_SET = 1;
+    static const int READY = 2;
+
+    ValueType* value_ptr() noexcept {
+        return reinterpret_cast<ValueType*>(&storage);
+    }
+
+    void publish() {
+        int prev = status.exchange(READY);
+        if (prev == CONTINUATION_SET) {
+            UniqueTask t(std::move(continuation));
+            t();
+        }
+        // Pairs with waiters setting has_waiters before checking status.
+        if (has_waiters.load()) {
+            FutureWaitStripe& stripe = future_wait_stripe(this);
+            {
+                std::lock_guard<std::mutex> lock(stripe.mtx);
+            }
+            stripe.cv.notify_all();
+        }
+    }
+
+    std::atomic<int> status;
+    std::atomic<bool> has_waiters;
+    bool has_value;
+    typename std::aligned_storage<sizeof(ValueType),
+            std::alignment_of<ValueType>::value>::type storage;
+    std::exception_ptr exception;
+    UniqueTask continuation;
+};
+
+template<class T>
+T unwrap_value(typename FutureValueType<T>::type&& v) {
+    return std::move(v);
+}
+
+template<>
+inline void unwrap_value<void>(Unit&&) {
+}
+
+/**
+ * Invoke a callable and complete a promise with its result or the exception it throws.
+ */
+template<class R>
+struct PromiseSetter {
+    template<class F, class ... Args>
+    static void apply(Promise<R>& p, F& f, Args&&... args) {
+        p.set_value(conc11::invoke(f, std::forward<Args>(args)...));
+    }
+};
+
+template<>
+struct PromiseSetter<void> {
+    template<class P, class F, class ... Args>
+    static void apply(P& p, F& f, Args&&... args) {
+        conc11::invoke(f, std::forward<Args>(args)...);
+        p.set_value();
+    }
+};
+
+template<class R, class F, class ... Args>
+void set_promise_from(Promise<R>& p, F& f, Args&&... args) {
+    try {
+        PromiseSetter<R>::apply(p, f, std::forward<Args>(args)...);
+    } catch (...) {
+        p.set_exception(std::current_exception());
+    }
+}
+
+/**
+ * Feeds the value of a ready upstream state into a continuation callable.
+ */
+template<class T>
+struct UpstreamInvoker {
+    template<class R, class F>
+    static void apply(FutureState<T>& upstream, Promise<R>& p, F& f) {
+        PromiseSetter<R>::apply(p, f, upstream.take());
+    }
+};
+
+template<>
+struct UpstreamInvoker<void> {
+    template<class R, class F>
+    static void apply(FutureState<void>& upstream, Promise<R>& p, F& f) {
+        upstream.take();
+        PromiseSetter<R>::apply(p, f);
+    }
+};
+
+template<class T, class F>
+struct ThenResult {
+    using type = decltype(conc11::invoke(std::declval<F&>(), std::declval<T>()));
+};
+
+template<class F>
+struct ThenResult<void, F> {
+    using type = decltype(conc11::invoke(std::declval<F&>()));
+};
+
+struct FutureAccess;
+
+} // namespace detail
+
+/**
+ * A lightweight future whose result is set through a conc11::Promise. Besides blocking get(),
+ * a continuation can be attached with then(), which is scheduled onto an executor once the
+ * result arrives, so that no thread blocks waiting for it.
+ * Unlike std::future, the shared state holds no mutex or condition variable, waiting threads
+ * park on a small global table of them instead.
+ */
+template<class T>
+class Future {
+public:
+    Future() noexcept = default;
+    Future(Future&&) noexcept = default;
+    Future& operator=(Future&&) noexcept = default;
+
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+
+    bool valid() const noexcept {
+        return static_cast<bool>(state);
+    }
+
+    bool is_ready() const {
+        check_valid();
+        return state->is_ready();
+    }
+
+    void wait() const {
+        check_valid();
+        state->wait();
+    }
+
+    template<class Rep, class Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout_duration) const {
+        return wait_until(std::chrono::steady_clock::now() + timeout_duration);
+    }
+
+    template<class Clock, class Duration>
+    bool wait_until(const std::chrono::time_point<Clock, Duration>& timeout_time) const {
+        check_valid();
+        return state->wait_until(timeout_time);
+    }
+
+    /**
+     * Wait for and return the result, or rethrow the exception. The future is no longer valid
+     * afterwards.
+     */
+    T get() {
+        check_valid();
+        std::shared_ptr<detail::FutureState<T>> s(std::move(state));
+        return detail::unwrap_value<T>(s->take());
+    }
+
+    /**
+     * Schedule f onto exec when the result is ready, passing the result as the only argument
+     * (none for Future<void>). Returns a future of the result of f. If this future holds an
+     * exception, f is not invoked and the exception is propagated to the returned future. This
+     * future is no longer valid afterwards.
+     * Executor may be any type providing execute(callable), ThreadPoolExecutor for example. If
+     * exec rejects the continuation, the returned future gets a broken_promise future_error.
+     */
+    template<class Executor, class F>
+    auto then(Executor& exec, F&& f)
+    -> Future<typename detail::ThenResult<T, typename std::decay<F>::type>::type> {
+        using Fn = typename std::decay<F>::type;
+        using R = typename detail::ThenResult<T, Fn>::type;
+        check_valid();
+        Promise<R> promise;
+        Future<R> ret = promise.get_future();
+        std::shared_ptr<detail::FutureState<T>> s(std::move(state));
+        detail::FutureState<T>* raw = s.get();
+        raw->set_continuation(UniqueTask(ScheduleContinuation<Executor, Fn, R>(exec,
+                std::forward<F>(f), std::move(s), std::move(promise))));
+        return ret;
+    }
+
+private:
+    friend class Promise<T>;
+    friend struct detail::FutureAccess;
+
+    explicit Future(std::shared_ptr<detail::FutureState<T>> s) noexcept:state(std::move(s)) {
+    }
+
+    void check_valid() const {
+        if (!state) {
+            throw(std::future_error(std::future_errc::no_state));
+        }
+    }
+
+    template<class Fn, class R>
+    class RunContinuation {
+    public:
+        RunContinuation(Fn&& f, std::shared_ptr<detail::FutureState<T>>&& upstream,
+                        Promise<R>&& promise) :
+                f(std::move(f)), upstream(std::move(upstream)), promise(std::move(promise)) {
+        }
+
+        RunContinuation(RunContinuation&&) = default;
+
+        void operator()() {
+            try {
+                detail::UpstreamInvoker<T>::apply(*upstream, promise, f);
+            } catch (...) {
+                promise.set_exception(std::current_exception());
+            }
+        }
+
+    private:
+        Fn f;
+        std::shared_ptr<detail::FutureState<T>> upstream;
+        Promise<R> promise;
+    };
+
+    template<class Executor, class Fn, class R>
+    class ScheduleContinuation {
+    public:
+        template<class UF>
+        ScheduleContinuation(Executor& exec, UF&& f,
+                             std::shared_ptr<detail::FutureState<T>>&& upstream,
+                             Promise<R>&& promise) :
+                exec(&exec), f(std::forward<UF>(f)), upstream(std::move(upstream)),
+                        promise(std::move(promise)) {
+        }
+
+        ScheduleContinuation(ScheduleContinuation&&) = default;
+
+        void operator()() {
+            try {
+                exec->execute(RunContinuation<Fn, R>(std::move(f), std::move(upstream),
+                        std::move(promise)));
+            } catch (...) {
+                // The promise has been moved into the rejected task and broken with it.
+            }
+        }
+
+    private:
+        Executor* exec;
+        Fn f;
+        std::shared_ptr<detail::FutureState<T>> upstream;
+        Promise<R> promise;
+    };
+
+    std::shared_ptr<detail::FutureState<T>> state;
+};
+
+/**
+ * The producing side of a conc11::Future. Destroying a promise without setting a result breaks
+ * it, completing its future with a std::future_error of broken_promise.
+ */
+template<class T>
+class Promise {
+public:
+    Promise() :
+            state(std::make_shared<detail::FutureState<T>>()) {
+    }
+
+    Promise(Promise&&) noexcept = default;
+
+    Promise& operator=(Promise&& rhs) noexcept {
+        if (this != &rhs) {
+            break_if_unsatisfied();
+            state = std::move(rhs.state);
+            satisfied = rhs.satisfied;
+            retrieved = rhs.retrieved;
+        }
+        return *this;
+    }
+
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+
+    ~Promise() {
+        break_if_unsatisfied();
+    }
+
+    Future<T> get_future() {
+        check_state();
+        if (retrieved) {
+            throw(std::future_error(std::future_errc::future_already_retrieved));
+        }
+        retrieved = true;
+        return Future<T>(state);
+    }
+
+    template<class ... Args>
+    void set_value(Args&&... args) {
+        check_satisfiable();
+        satisfied = true;
+        state->set_value(std::forward<Args>(args)...);
+    }
+
+    void set_exception(std::exception_ptr e) {
+        check_satisfiable();
+        satisfied = true;
+        state->set_exception(e);
+    }
+
+private:
+    void check_state() const {
+        if (!state) {
+            throw(std::future_error(std::future_errc::no_state));
+        }
+    }
+
+    void check_satisfiable() const {
+        check_state();
+        if (satisfied) {
+            throw(std::future_error(std::future_errc::promise_already_satisfied));
+        }
+    }
+
+    void break_if_unsatisfied() noexcept {
+        if (state && !satisfied) {
+            satisfied = true;
+            state->set_exception(std::make_exception_ptr(
+                    std::future_error(std::future_errc::broken_promise)));
+        }
+    }
+
+    std::shared_ptr<detail::FutureState<T>> state;
+    bool satisfied = false;
+    bool retrieved = false;
+};
+
+template<class T>
+Future<typename std::decay<T>::type> make_ready_future(T&& value) {
+    Promise<typename std::decay<T>::type> p;
+    p.set_value(std::forward<T>(value));
+    return p.get_future();
+}
+
+inline Future<void> make_ready_future() {
+    Promise<void> p;
+    p.set_value();
+    return p.get_future();
+}
+
+namespace detail {
+
+struct FutureAccess {
+    template<class T>
+    static FutureState<T>& state_of(Future<T>& f) {
+        f.check_valid();
+        return *f.state;
+    }
+};
+
+template<class T>
+struct WhenAllContext {
+    using ResultType = std::vector<T>;
+
+    explicit WhenAllContext(std::vector<Future<T>>&& futures) :
+            futures(std::move(futures)), remaining(this->futures.size()) {
+    }
+
+    void complete() {
+        ResultType result;
+        result.reserve(futures.size());
+        try {
+            for (auto& f : futures) {
+                result.emplace_back(f.get());
+            }
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            return;
+        }
+        promise.set_value(std::move(result));
+    }
+
+    std::vector<Future<T>> futures;
+    std::atomic<std::size_t> remaining;
+    Promise<ResultType> promise;
+};
+
+template<>
+struct WhenAllContext<void> {
+    using ResultType = void;
+
+    explicit WhenAllContext(std::vector<Future<void>>&& futures) :
+            futures(std::move(futures)), remaining(this->futures.size()) {
+    }
+
+    void complete() {
+        try {
+            for (auto& f : futures) {
+                f.get();
+            }
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            return;
+        }
+        promise.set_value();
+    }
+
+    std::vector<Future<void>> futures;
+    std::atomic<std::size_t> remaining;
+    Promise<void> promise;
+};
+
+template<class T>
+struct WhenAllCountDown {
+    void operator()() {
+        if (ctx->remaining.fetch_sub(1) == 1) {
+            ctx->complete();
+        }
+    }
+    std::shared_ptr<WhenAllContext<T>> ctx;
+};
+
+template<class T>
+struct WhenAnyContext {
+    using ResultType = std::pair<std::size_t, T>;
+
+    explicit WhenAnyContext(std::vector<Future<T>>&& futures) :
+            futures(std::move(futures)), done(false) {
+    }
+
+    void complete(std::size_t index) {
+        try {
+            promise.set_value(ResultType(index, futures[index].get()));
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    }
+
+    std::vector<Future<T>> futures;
+    std::atomic<bool> done;
+    Promise<ResultType> promise;
+};
+
+template<>
+struct WhenAnyContext<void> {
+    using ResultType = std::size_t;
+
+    explicit WhenAnyContext(std::vector<Future<void>>&& futures) :
+            futures(std::move(futures)), done(false) {
+    }
+
+    void complete(std::size_t index) {
+        try {
+            futures[index].get();
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            return;
+        }
+        promise.set_value(index);
+    }
+
+    std::vector<Future<void>> futures;
+    std::atomic<bool> done;
+    Promise<ResultType> promise;
+};
+
+template<class T>
+struct WhenAnyFirst {
+    void operator()() {
+        if (!ctx->done.exchange(true)) {
+            ctx->complete(index);
+        }
+    }
+    std::shared_ptr<WhenAnyContext<T>> ctx;
+    std::size_t index;
+};
+
+} // namespace detail
+
+/**
+ * Returns a future that becomes ready when all of the given futures are ready. Its result is the
+ * results of all futures in order (nothing for Future<void>), or the exception of the first
+ * future in order that holds one.
+ */
+template<class T>
+auto when_all(std::vector<Future<T>> futures)
+-> Future<typename detail::WhenAllContext<T>::ResultType> {
+    auto ctx = std::make_shared<detail::WhenAllContext<T>>(std::move(futures));
+    auto ret = ctx->promise.get_future();
+    if (ctx->futures.empty()) {
+        ctx->complete();
+        return ret;
+    }
+    for (auto& f : ctx->futures) {
+        detail::FutureAccess::state_of(f).set_continuation(
+                UniqueTask(detail::WhenAllCountDown<T>{ctx}));
+    }
+    return ret;
+}
+
+/**
+ * Returns a future that becomes ready when any of the given futures is ready. Its result is the
+ * index of the first ready future paired with its result (only the index for Future<void>), or
+ * the exception that future holds. Results of the other futures are discarded. Throws
+ * std::invalid_argument if futures is empty.
+ */
+template<class T>
+auto when_any(std::vector<Future<T>> futures)
+-> Future<typename detail::WhenAnyContext<T>::ResultType> {
+    if (futures.empty()) {
+        throw(std::invalid_argument("when_any() requires at least one future"));
+    }
+    auto ctx = std::make_shared<detail::WhenAnyContext<T>>(std::move(futures));
+    auto ret = ctx->promise.get_future();
+    for (std::size_t i = 0; i < ctx->futures.size(); ++i) {
+        detail::FutureAccess::state_of(ctx->futures[i]).set_continuation(
+                UniqueTask(detail::WhenAnyFirst<T>{ctx, i}));
+    }
+    return ret;
+}
+
+} // namespace conc11
+
+#endif /* CONCURRENCY_FUTURE_H_ */
@@ -0,0 +1,247 @@
+/**
+ * mpmc_queue.h
+ */
+#ifndef CONCURRENCY_MPMC_QUEUE_H_
+#define CONCURRENCY_MPMC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "../util/bits/cache_line.h"
+
+namespace conc11 {
+
+/**
+ * A bounded lock-free multi-producer multi-consumer FIFO queue after Dmitry Vyukov. Elements are
+ * stored inline in a ring of slots, each carrying a sequence number that tells producers and
+ * consumers whether the slot is free or holds an element for the current lap. A producer or
+ * consumer claims a slot with one compare-and-swap on the shared tail or head index, which are
+ * kept on separate cache lines.
+ * Operations never block: try_push() fails when the queue is full and try_pop() fails when it
+ * is empty. A slot claimed by a thread that was preempted before publishing it delays the
+ * elements behind it until that thread resumes.
+ */
+template<class T>
+class MPMCQueue {
+public:
+    explicit MPMCQueue(std::size_t min_capacity) :
+            cap(round_up_capacity(min_capacity)), mask(cap - 1), slots(new Slot[cap]),
+                    tail(0), head(0) {
+        for (std::size_t i = 0; i < cap; ++i) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MPMCQueue() {
+        // Destructor shall not race with producers or consumers.
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        for (std::size_t h = head.load(std::memory_order_relaxed); h != t; ++h) {
+            slot_at(h).get()->~T();
+        }
+    }
+
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+    /**
+     * Push an element at the tail. Returns false and leaves value untouched if the queue is full.
+     */
+    bool try_push(T&& value) {
+        return try_emplace(std::move(value));
+    }
+
+    bool try_push(const T& value) {
+        return try_emplace(value);
+    }
+
+    /**
+     * Construct an element at the tail from args. Returns false if the queue is full, in which
+     * case args are not used.
+     */
+    template<class ... Args>
+    bool try_emplace(Args&&... args) {
+        std::size_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            std::size_t seq = slot_at(pos).seq.load(std::memory_order_acquire);
+            std::ptrdiff_t lag = static_cast<std::ptrdiff_t>(seq - pos);
+            if (lag == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (lag < 0) {
+                return false; // the slot still holds the element of the previous lap
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        Slot& slot = slot_at(pos);
+        new (&slot.storage) T(std::forward<Args>(args)...);
+        slot.seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Pop the element at the head into out. Returns false if the queue is empty.
+     */
+    bool try_pop(T* out) {
+        std::size_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            std::size_t seq = slot_at(pos).seq.load(std::memory_order_acquire);
+            std::ptrdiff_t lag = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+            if (lag == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (lag < 0) {
+                return false; // not yet published for this lap
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+        move_out(pos, out);
+        return true;
+    }
+
+    /**
+     * Push a prefix of [first, last) as one contiguous run, claiming all its slots with a
+     * single compare-and-swap. Elements are constructed from *it, pass move iterators to move
+     * them. Returns the number of elements pushed, the rest are left untouched.
+     */
+    template<class ForwardIt>
+    std::size_t try_push_n(ForwardIt first, ForwardIt last) {
+        std::size_t n = static_cast<std::size_t>(std::distance(first, last));
+        std::size_t pos;
+        std::size_t k = claim(tail, n, 0, &pos);
+        for (std::size_t i = 0; i < k; ++i, ++first) {
+            Slot& slot = slot_at(pos + i);
+            new (&slot.storage) T(*first);
+            slot.seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return k;
+    }
+
+    /**
+     * Pop up to n elements from the head, assigning them to *out++ in order. Returns the number
+     * of elements popped.
+     */
+    template<class OutputIt>
+    std::size_t try_pop_n(OutputIt out, std::size_t n) {
+        std::size_t pos;
+        std::size_t k = claim(head, n, 1, &pos);
+        for (std::size_t i = 0; i < k; ++i, ++out) {
+            move_out(pos + i, out);
+        }
+        return k;
+    }
+
+    /**
+     * Returns true if no element is ready at the head, so that try_pop() would fail. An element
+     * counts once its producer has finished pushing it. Approximate when called concurrently.
+     */
+    bool empty() const noexcept {
+        std::size_t h = head.load(std::memory_order_seq_cst);
+        std::size_t seq = slots[h & mask].seq.load(std::memory_order_acquire);
+        return static_cast<std::ptrdiff_t>(seq - (h + 1)) < 0;
+    }
+
+    /**
+     * Returns number of elements in the queue, including ones still being pushed. Approximate
+     * when called concurrently.
+     */
+    std::size_t size() const noexcept {
+        std::size_t h = head.load(std::memory_order_seq_cst);
+        std::size_t t = tail.load(std::memory_order_seq_cst);
+        std::ptrdiff_t n = static_cast<std::ptrdiff_t>(t - h);
+        return n > 0 ? static_cast<std::size_t>(n) : 0;
+    }
+
+    std::size_t capacity() const noexcept {
+        return cap;
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> seq;
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+
+        T* get() noexcept {
+            return reinterpret_cast<T*>(&storage);
+        }
+    };
+
+    static std::size_t round_up_capacity(std::size_t min_capacity) noexcept {
+        std::size_t c = 2;
+        while (c < min_capacity) {
+            c <<= 1;
+        }
+        return c;
+    }
+
+    Slot& slot_at(std::size_t index) noexcept {
+        return slots[index & mask];
+    }
+
+    /**
+     * Claim a run of up to n consecutive slots starting at index, which is tail for producers,
+     * with ready sequence offset 0, and head for consumers, with offset 1. A slot is ready when
+     * its sequence equals its position plus offset. Returns the length of the run and stores its
+     * first position to pos.
+     */
+    std::size_t claim(std::atomic<std::size_t>& index, std::size_t n, std::size_t offset,
+                      std::size_t* pos) {
+        std::size_t p = index.load(std::memory_order_relaxed);
+        while (n > 0) {
+            std::size_t k = 0;
+            std::ptrdiff_t lag = 0;
+            for (; k < n && k < cap; ++k) {
+                std::size_t seq = slot_at(p + k).seq.load(std::memory_order_acquire);
+                lag = static_cast<std::ptrdiff_t>(seq - (p + k + offset));
+                if (lag != 0) {
+                    break;
+                }
+            }
+            if (k == 0) {
+                if (lag < 0) {
+                    break; // full or empty
+                }
+                p = index.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (index.compare_exchange_weak(p, p + k, std::memory_order_relaxed)) {
+                *pos = p;
+                return k;
+            }
+        }
+        *pos = p;
+        return 0;
+    }
+
+    template<class OutputIt>
+    void move_out(std::size_t pos, OutputIt& out) {
+        Slot& slot = slot_at(pos);
+        T* p = slot.get();
+        *out = std::move(*p);
+        p->~T();
+        slot.seq.store(pos + cap, std::memory_order_release);
+    }
+
+    const std::size_t cap;
+    const std::size_t mask;
+    std::unique_ptr<Slot[]> slots;
+
+    // tail is written by producers and head by consumers, keep them on separate cache lines.
+    char pad0[CACHE_LINE_SIZE];
+    std::atomic<std::size_t> tail;
+    char pad1[CACHE_LINE_SIZE - sizeof(std::atomic<std::size_t>)];
+    std::atomic<std::size_t> head;
+    char pad2[CACHE_LINE_SIZE - sizeof(std::atomic<std::size_t>)];
+};
+
+} // namespace conc11
+
+#endif /* CONCURRENCY_MPMC_QUEUE_H_ */
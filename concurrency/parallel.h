@@ -0,0 +1,316 @@
+/**
+ * parallel.h
+ * Parallel loop, reduction and transform algorithms running on a ThreadPoolExecutor.
+ */
+#ifndef CONCURRENCY_PARALLEL_H_
+#define CONCURRENCY_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+#include "executor.h"
+#include "latch.h"
+#include "../util/util.h"
+
+namespace conc11 {
+
+/**
+ * How the iteration space of a parallel algorithm is split into chunks.
+ */
+enum class Partitioning {
+    // One chunk per participating thread. Lowest overhead when iterations cost the same.
+    STATIC,
+    // Chunks of grain size claimed one after another. Balances irregular iterations.
+    DYNAMIC,
+    // Chunks proportional to the remaining iterations, shrinking down to grain size. Few claims
+    // at the start while still balancing the tail.
+    GUIDED
+};
+
+namespace detail {
+
+/**
+ * State shared by the calling thread and the helper tasks of one parallel algorithm. Lives on
+ * the heap, as helper tasks may start after the algorithm has already returned, in which case
+ * they find nothing left to claim and exit.
+ */
+class ParallelLoopState {
+public:
+    ParallelLoopState(size_t n, size_t participants, Partitioning partitioning, size_t grain) :
+            n(n), participants(participants), partitioning(partitioning), grain(grain),
+                    next(0), done(static_cast<std::ptrdiff_t>(n)), failed(false) {
+    }
+
+    ParallelLoopState(const ParallelLoopState&) = delete;
+    ParallelLoopState& operator=(const ParallelLoopState&) = delete;
+
+    /**
+     * Claim the next chunk [*begin, *end). Returns false if the iteration space is exhausted.
+     */
+    bool claim(size_t* begin, size_t* end) {
+        size_t b;
+        size_t len;
+        if (partitioning == Partitioning::GUIDED) {
+            b = next.load(std::memory_order_relaxed);
+            do {
+                if (b >= n) {
+                    return false;
+                }
+                len = std::max(grain, (n - b) / (2 * participants));
+            } while (!next.compare_exchange_weak(b, b + len, std::memory_order_relaxed));
+        } else {
+            len = partitioning == Partitioning::STATIC ?
+                    (n + participants - 1) / participants : grain;
+            b = next.fetch_add(len, std::memory_order_relaxed);
+            if (b >= n) {
+                return false;
+            }
+        }
+        *begin = b;
+        *end = std::min(n, b + len);
+        return true;
+    }
+
+    /**
+     * Claim and run chunks until exhausted, calling body(participant, begin, end) for each.
+     * After the first exception, remaining chunks are claimed but skipped.
+     */
+    template<class Body>
+    void participate(size_t participant, Body* body) {
+        size_t b;
+        size_t e;
+        while (claim(&b, &e)) {
+            if (!failed.load(std::memory_order_relaxed)) {
+                try {
+                    (*body)(participant, b, e);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(error_lock);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    failed.store(true, std::memory_order_relaxed);
+                }
+            }
+            done.count_down(static_cast<std::ptrdiff_t>(e - b));
+        }
+    }
+
+    void wait_and_rethrow() {
+        done.wait();
+        std::lock_guard<std::mutex> lock(error_lock);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    const size_t n;
+    const size_t participants;
+
+private:
+    const Partitioning partitioning;
+    const size_t grain;
+
+    std::atomic<size_t> next;
+    Latch done;
+    std::atomic<bool> failed;
+    std::mutex error_lock;
+    std::exception_ptr error;
+};
+
+template<class Body>
+struct ParallelHelper {
+    void operator()(size_t i) {
+        state->participate(i + 1, body);
+    }
+    std::shared_ptr<ParallelLoopState> state;
+    Body* body;
+};
+
+inline size_t parallel_participants(ThreadPoolExecutor& exec, size_t n) {
+    size_t p = exec.get_pool_size() + 1;
+    return std::max<size_t>(1, std::min(p, n));
+}
+
+/**
+ * Run body(participant, begin, end) over chunks of [0, n) on the calling thread and up to
+ * participants - 1 helper tasks. Participant 0 is the calling thread.
+ */
+template<class Body>
+void run_parallel(ThreadPoolExecutor& exec, size_t n, size_t participants,
+                  Partitioning partitioning, size_t grain_size, Body& body) {
+    if (n == 0) {
+        return;
+    }
+    size_t grain = grain_size;
+    if (grain == 0) {
+        size_t chunks_per_participant = partitioning == Partitioning::GUIDED ? 64 : 16;
+        grain = std::max<size_t>(1, n / (participants * chunks_per_participant));
+    }
+    auto state = std::make_shared<ParallelLoopState>(n, participants, partitioning, grain);
+    if (participants > 1) {
+        try {
+            exec.execute_n(participants - 1, ParallelHelper<Body>{state, &body});
+        } catch (std::system_error&) {
+            // Executor is shut down, the calling thread does all the work.
+        }
+    }
+    state->participate(0, &body);
+    state->wait_and_rethrow();
+}
+
+template<class Index, class Function>
+struct ParallelForBody {
+    void operator()(size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            (*f)(static_cast<Index>(first + static_cast<Index>(i)));
+        }
+    }
+    Index first;
+    Function* f;
+};
+
+template<class T>
+struct PaddedPartial {
+    explicit PaddedPartial(const T& v) :
+            value(v) {
+    }
+    T value;
+    char pad[CACHE_LINE_SIZE];
+};
+
+/**
+ * The partial result of the elements [begin, end).
+ */
+template<class T>
+struct ReduceChunk {
+    size_t begin;
+    size_t end;
+    T value;
+};
+
+template<class RandomIt, class T, class BinaryOp>
+struct ParallelReduceBody {
+    void operator()(size_t participant, size_t begin, size_t end) {
+        // Chunks that continue the previous one of the participant extend its partial result,
+        // others start a new one, so that partials cover contiguous ranges only.
+        std::vector<ReduceChunk<T>>& chunks = (*partials)[participant].value;
+        if (chunks.empty() || chunks.back().end != begin) {
+            chunks.push_back(ReduceChunk<T>{begin, begin, *identity});
+        }
+        ReduceChunk<T>& chunk = chunks.back();
+        RandomIt it = first + begin;
+        for (size_t i = begin; i < end; ++i, ++it) {
+            chunk.value = (*op)(std::move(chunk.value), *it);
+        }
+        chunk.end = end;
+    }
+    RandomIt first;
+    const T* identity;
+    BinaryOp* op;
+    std::vector<PaddedPartial<std::vector<ReduceChunk<T>>>>* partials;
+};
+
+template<class InputIt, class OutputIt, class UnaryOp>
+struct ParallelTransformBody {
+    void operator()(size_t, size_t begin, size_t end) {
+        InputIt in = first + begin;
+        OutputIt out = d_first + begin;
+        for (size_t i = begin; i < end; ++i, ++in, ++out) {
+            *out = (*op)(*in);
+        }
+    }
+    InputIt first;
+    OutputIt d_first;
+    UnaryOp* op;
+};
+
+} // namespace detail
+
+/**
+ * Calls f(i) for every i in [first, last) in parallel on exec and the calling thread, returning
+ * when all calls have finished. Index must be an integral type.
+ * If grain_size is 0 it is chosen from the number of iterations and threads. If any call throws,
+ * remaining chunks are skipped and the first exception is rethrown in the calling thread.
+ * May be called from tasks running on exec, since the calling thread takes part in the work.
+ */
+template<class Index, class Function>
+void parallel_for(ThreadPoolExecutor& exec, Index first, Index last, Function&& f,
+                  Partitioning partitioning = Partitioning::GUIDED, size_t grain_size = 0) {
+    static_assert(std::is_integral<Index>::value, "parallel_for requires an integral index");
+    if (!(first < last)) {
+        return;
+    }
+    using Fn = typename std::remove_reference<Function>::type;
+    size_t n = static_cast<size_t>(last - first);
+    detail::ParallelForBody<Index, Fn> body{first, &f};
+    detail::run_parallel(exec, n, detail::parallel_participants(exec, n), partitioning,
+            grain_size, body);
+}
+
+/**
+ * Reduces [first, last) with op in parallel, as std::accumulate(first, last, identity, op) would
+ * if op is associative and identity is its neutral element. op is called both to fold elements
+ * into a partial result and to combine two partial results. Every thread folds its chunks into
+ * private partial results, one per contiguous run of chunks it claimed, and the calling thread
+ * combines them in range order at the end, so op need not be commutative and no shared atomics
+ * are touched per element.
+ */
+template<class RandomIt, class T, class BinaryOp>
+T parallel_reduce(ThreadPoolExecutor& exec, RandomIt first, RandomIt last, T identity,
+                  BinaryOp op, Partitioning partitioning = Partitioning::GUIDED,
+                  size_t grain_size = 0) {
+    size_t n = static_cast<size_t>(std::distance(first, last));
+    if (n == 0) {
+        return identity;
+    }
+    size_t participants = detail::parallel_participants(exec, n);
+    std::vector<detail::PaddedPartial<std::vector<detail::ReduceChunk<T>>>> partials;
+    partials.reserve(participants);
+    for (size_t i = 0; i < participants; ++i) {
+        partials.emplace_back(std::vector<detail::ReduceChunk<T>>());
+    }
+    detail::ParallelReduceBody<RandomIt, T, BinaryOp> body{first, &identity, &op, &partials};
+    detail::run_parallel(exec, n, participants, partitioning, grain_size, body);
+    std::vector<detail::ReduceChunk<T>*> chunks;
+    for (auto& partial : partials) {
+        for (auto& chunk : partial.value) {
+            chunks.push_back(&chunk);
+        }
+    }
+    std::sort(chunks.begin(), chunks.end(),
+            [](const detail::ReduceChunk<T>* a, const detail::ReduceChunk<T>* b) {
+                return a->begin < b->begin;
+            });
+    T result = std::move(identity);
+    for (auto chunk : chunks) {
+        result = op(std::move(result), std::move(chunk->value));
+    }
+    return result;
+}
+
+/**
+ * Applies op to every element of [first, last) in parallel, storing the results to the range
+ * beginning at d_first. Both ranges must be random access. Returns the end of the output range.
+ */
+template<class InputIt, class OutputIt, class UnaryOp>
+OutputIt parallel_transform(ThreadPoolExecutor& exec, InputIt first, InputIt last,
+                            OutputIt d_first, UnaryOp op,
+                            Partitioning partitioning = Partitioning::GUIDED,
+                            size_t grain_size = 0) {
+    size_t n = static_cast<size_t>(std::distance(first, last));
+    detail::ParallelTransformBody<InputIt, OutputIt, UnaryOp> body{first, d_first, &op};
+    detail::run_parallel(exec, n, detail::parallel_participants(exec, n), partitioning,
+            grain_size, body);
+    return d_first + n;
+}
+
+} // namespace conc11
+
+#endif /* CONCURRENCY_PARALLEL_H_ */
@@ -0,0 +1,283 @@
+/**
+ * rate_limiter.h
+ */
+#ifndef CONCURRENCY_RATE_LIMITER_H_
+#define CONCURRENCY_RATE_LIMITER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+namespace conc11 {
+
+/**
+ * A token bucket rate limiter that refills lazily from steady_clock when permits are requested,
+ * instead of from a timer thread. Acquiring permits reserves them, followed by a sleep until the
+ * reservation is due, which is computed exactly rather than polled.
+ *
+ * By default it is a generic cell rate algorithm: the whole state is one 64-bit word holding the
+ * theoretical arrival time of the next permit, so a reservation is a single compare-and-swap, and
+ * after being idle up to burst permits are handed out at once. With a warm-up period, as in
+ * Guava's SmoothWarmingUp, it starts cold after idling: the interval between permits starts at
+ * cold_factor times the stable interval and falls to the stable one over the warm-up period under
+ * full demand. A request is then granted when the previous one has been paid for, and its own
+ * cost delays the next one. The stored permits and the time the limiter is free again do not fit
+ * one word at full precision, so they are updated under a short lock.
+ *
+ * Acquired permits are not returned, release() does nothing, so that a RateLimiter can be used
+ * with SemaphoreGuard and SemaphoreTimedLockableAdapter.
+ */
+class RateLimiter {
+public:
+    /**
+     * Hand out permits_per_second permits per second, and up to burst permits at once.
+     */
+    explicit RateLimiter(double permits_per_second, double burst = 1.0) :
+            interval(1e9 / check_rate(permits_per_second)),
+                    burst_nanoseconds(std::llround(check_at_least_one(burst) * interval)),
+                    warmup(false), threshold_permits(0), max_permits(0), slope(0),
+                    cool_down_nanoseconds(0), start(std::chrono::steady_clock::now()), state(0),
+                    stored_permits(0), free_nanoseconds(0), free_fraction(0) {
+    }
+
+    /**
+     * Hand out permits_per_second permits per second after warming up for warmup_period from
+     * cold_factor times slower. The limiter starts cold, and cools down again when idle.
+     */
+    RateLimiter(double permits_per_second, std::chrono::nanoseconds warmup_period,
+                double cold_factor = 3.0) :
+            interval(1e9 / check_rate(permits_per_second)), burst_nanoseconds(0), warmup(true),
+                    threshold_permits(0), max_permits(0), slope(0), cool_down_nanoseconds(0),
+                    start(std::chrono::steady_clock::now()), state(0), stored_permits(0),
+                    free_nanoseconds(0), free_fraction(0) {
+        double warmup_nanoseconds = static_cast<double>(warmup_period.count());
+        if (!(warmup_nanoseconds > 0)) {
+            throw(std::system_error(std::make_error_code(std::errc::invalid_argument)));
+        }
+        double cold_interval = interval * check_at_least_one(cold_factor);
+        threshold_permits = 0.5 * warmup_nanoseconds / interval;
+        max_permits = threshold_permits + 2.0 * warmup_nanoseconds / (interval + cold_interval);
+        slope = (cold_interval - interval) / (max_permits - threshold_permits);
+        cool_down_nanoseconds = warmup_nanoseconds / max_permits;
+        stored_permits = max_permits;
+    }
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    void acquire() {
+        acquire(1);
+    }
+
+    void acquire(unsigned int request) {
+        int64_t due;
+        reserve(request, std::numeric_limits<int64_t>::max(), &due);
+        sleep_until_due(due);
+    }
+
+    /**
+     * Does nothing, permits are replenished by time only.
+     */
+    void release() {
+    }
+
+    void release(unsigned int) {
+    }
+
+    /**
+     * Acquire permits only if that needs no waiting.
+     */
+    bool try_acquire() {
+        return try_acquire(1);
+    }
+
+    bool try_acquire(unsigned int request) {
+        int64_t due;
+        return reserve(request, 0, &due);
+    }
+
+    bool try_acquire_for(unsigned long millis, unsigned int micros) {
+        return try_acquire_for(1, millis, micros);
+    }
+
+    bool try_acquire_for(unsigned int request, unsigned long millis, unsigned int micros) {
+        return try_acquire_for(request,
+                std::chrono::milliseconds(millis) + std::chrono::microseconds(micros));
+    }
+
+    template<class Rep, class Period>
+    bool try_acquire_for(const std::chrono::duration<Rep, Period>& timeout_duration) {
+        return try_acquire_for(1, timeout_duration);
+    }
+
+    /**
+     * Acquire permits if they are due within timeout_duration, waiting exactly until they are.
+     * Returns false at once, without waiting, if they are not.
+     */
+    template<class Rep, class Period>
+    bool try_acquire_for(unsigned int request,
+                         const std::chrono::duration<Rep, Period>& timeout_duration) {
+        int64_t max_wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                timeout_duration).count();
+        int64_t due;
+        if (!reserve(request, std::max<int64_t>(max_wait, 0), &due)) {
+            return false;
+        }
+        sleep_until_due(due);
+        return true;
+    }
+
+    template<class Clock, class Duration>
+    bool try_acquire_until(const std::chrono::time_point<Clock, Duration> &timeout_time) {
+        return try_acquire_until(1, timeout_time);
+    }
+
+    template<class Clock, class Duration>
+    bool try_acquire_until(unsigned int request,
+                           const std::chrono::time_point<Clock, Duration> &timeout_time) {
+        return try_acquire_for(request, timeout_time - Clock::now());
+    }
+
+    /**
+     * Number of permits that can be acquired now without waiting. With a warm-up period, a
+     * request of any size is granted without waiting while the limiter is free, and this
+     * returns 1 or 0.
+     */
+    int available_permits() const noexcept {
+        int64_t now = now_nanoseconds();
+        if (warmup) {
+            std::lock_guard<std::mutex> guard(warmup_lock);
+            return free_nanoseconds <= now ? 1 : 0;
+        }
+        uint64_t s = state.load();
+        int64_t tat = std::max(static_cast<int64_t>(s), now);
+        double n = std::floor(static_cast<double>(now + burst_nanoseconds - tat) / interval);
+        return n > 0 ? static_cast<int>(std::min<double>(n, std::numeric_limits<int>::max())) : 0;
+    }
+
+    double get_rate() const noexcept {
+        return 1e9 / interval;
+    }
+
+private:
+    static double check_rate(double permits_per_second) {
+        if (!(permits_per_second > 0)) {
+            throw(std::system_error(std::make_error_code(std::errc::invalid_argument)));
+        }
+        return permits_per_second;
+    }
+
+    static double check_at_least_one(double x) {
+        if (!(x >= 1)) {
+            throw(std::system_error(std::make_error_code(std::errc::invalid_argument)));
+        }
+        return x;
+    }
+
+    int64_t now_nanoseconds() const noexcept {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * Reserve request permits if they are due within max_wait nanoseconds, and store when they
+     * are due, in nanoseconds since start, to due.
+     */
+    bool reserve(unsigned int request, int64_t max_wait, int64_t* due) {
+        int64_t now = now_nanoseconds();
+        if (warmup) {
+            return reserve_warming(request, max_wait, now, due);
+        }
+        uint64_t s = state.load();
+        while (true) {
+            int64_t tat = std::max(static_cast<int64_t>(s), now) +
+                    std::llround(request * interval);
+            *due = std::max(tat - burst_nanoseconds, now);
+            if (*due - now > max_wait) {
+                return false;
+            }
+            if (state.compare_exchange_weak(s, static_cast<uint64_t>(tat))) {
+                return true;
+            }
+        }
+    }
+
+    /**
+     * reserve() with a warm-up period. The fraction of a nanosecond left over by each cost is
+     * carried to the next, so that permits cheaper than a nanosecond are still paid for.
+     */
+    bool reserve_warming(unsigned int request, int64_t max_wait, int64_t now, int64_t* due) {
+        std::lock_guard<std::mutex> guard(warmup_lock);
+        if (now > free_nanoseconds) {
+            double idle = static_cast<double>(now - free_nanoseconds) - free_fraction;
+            stored_permits = std::min(max_permits,
+                    stored_permits + std::max(idle, 0.0) / cool_down_nanoseconds);
+            free_nanoseconds = now;
+            free_fraction = 0;
+        }
+        *due = free_nanoseconds;
+        if (*due - now > max_wait) {
+            return false;
+        }
+        double from_stored = std::min<double>(request, stored_permits);
+        double cost = free_fraction + stored_permits_to_nanoseconds(stored_permits, from_stored) +
+                (request - from_stored) * interval;
+        double whole = std::floor(cost);
+        free_nanoseconds += static_cast<int64_t>(whole);
+        free_fraction = cost - whole;
+        stored_permits -= from_stored;
+        return true;
+    }
+
+    /**
+     * Time to hand out k of the stored permits, at the stable interval below the threshold and
+     * rising linearly to the cold interval above it.
+     */
+    double stored_permits_to_nanoseconds(double stored, double k) const noexcept {
+        double above = stored - threshold_permits;
+        double nanoseconds = 0;
+        if (above > 0) {
+            double taken = std::min(above, k);
+            nanoseconds = taken * (2 * interval + slope * (2 * above - taken)) / 2;
+            k -= taken;
+        }
+        return nanoseconds + interval * k;
+    }
+
+    void sleep_until_due(int64_t due) {
+        if (due > now_nanoseconds()) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(due));
+        }
+    }
+
+    // Nanoseconds between permits at the stable rate
+    const double interval;
+    // Credit that a full bucket holds
+    const int64_t burst_nanoseconds;
+    const bool warmup;
+    double threshold_permits;
+    double max_permits;
+    // Nanoseconds per permit of the cold interval above the threshold
+    double slope;
+    // Nanoseconds of idling that store one permit
+    double cool_down_nanoseconds;
+    const std::chrono::steady_clock::time_point start;
+    // Theoretical arrival time of the next permit without a warm-up period
+    std::atomic<uint64_t> state;
+    // Warm-up state, protected by warmup_lock: the stored permits, and the time the limiter is
+    // free again, in nanoseconds since start and the fraction of a nanosecond beyond
+    mutable std::mutex warmup_lock;
+    double stored_permits;
+    int64_t free_nanoseconds;
+    double free_fraction;
+};
+
+} // namespace conc11
+
+#endif /* CONCURRENCY_RATE_LIMITER_H_ */
@@ -0,0 +1,617 @@
+/**
+ * scheduled_executor.h
+ */
+#ifndef CONCURRENCY_SCHEDULED_EXECUTOR_H_
+#define CONCURRENCY_SCHEDULED_EXECUTOR_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "executor.h"
+#include "../util/util.h"
+
+namespace conc11 {
+
+namespace detail {
+
+struct TimerQueue;
+
+/**
+ * A pending timer. Linked into a wheel slot while scheduled, during which the node owns a
+ * reference to itself so that it outlives any handle.
+ */
+struct TimerNode {
+    static const int SCHEDULED = 0;
+    static const int RUNNING = 1;
+    static const int DONE = 2;
+    static const int CANCELLED = 3;
+
+    enum class Kind {
+        ONE_SHOT, FIXED_RATE, FIXED_DELAY
+    };
+
+    TimerNode(UniqueTask&& task, Kind kind, uint64_t period_ticks,
+              const std::weak_ptr<TimerQueue>& queue) :
+            task(std::move(task)), kind(kind), period_ticks(period_ticks), queue(queue),
+                    state(SCHEDULED) {
+    }
+
+    UniqueTask task;
+    const Kind kind;
+    const uint64_t period_ticks;
+    const std::weak_ptr<TimerQueue> queue;
+    std::atomic<int> state;
+
+    // Fields below are protected by the lock of the timer queue
+    uint64_t expires = 0;
+    TimerNode** slot = nullptr;
+    TimerNode* prev = nullptr;
+    TimerNode* next = nullptr;
+    std::shared_ptr<TimerNode> self;
+};
+
+/**
+ * A hierarchical timing wheel. Level k has 64 slots of 64^k ticks each, so four levels cover
+ * 2^24 ticks; timers further out are parked in the last level and re-sorted when their slot
+ * comes up. Inserting and removing a timer are O(1), and advancing the wheel by a tick only
+ * touches timers that expire in it or cascade down a level.
+ * Not thread safe.
+ */
+class TimerWheel {
+public:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const uint64_t SLOTS = 1 << SLOT_BITS;
+    static const uint64_t SLOT_MASK = SLOTS - 1;
+
+    TimerWheel() {
+        for (int l = 0; l < LEVELS; ++l) {
+            for (uint64_t s = 0; s < SLOTS; ++s) {
+                slots[l][s] = nullptr;
+            }
+        }
+    }
+
+    ~TimerWheel() {
+        clear();
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    /**
+     * Insert a timer expiring at the given absolute tick. Ticks already passed fire on the next
+     * advance.
+     */
+    void insert(const std::shared_ptr<TimerNode>& node, uint64_t expires) {
+        node->expires = expires < current ? current : expires;
+        node->self = node;
+        link(node.get());
+        ++pending;
+    }
+
+    /**
+     * Remove a timer if it is in the wheel. Returns false if it was not.
+     */
+    bool remove(TimerNode* node) {
+        if (!node->self) {
+            return false;
+        }
+        unlink(node);
+        --pending;
+        node->self.reset();
+        return true;
+    }
+
+    /**
+     * Process the current tick, appending expired timers to fired, and move to the next tick.
+     */
+    void advance(std::vector<std::shared_ptr<TimerNode>>* fired) {
+        // Cascade timers of the higher level slots that begin at this tick one level down
+        for (int l = 1; l < LEVELS; ++l) {
+            if (((current >> ((l - 1) * SLOT_BITS)) & SLOT_MASK) != 0) {
+                break;
+            }
+            TimerNode*& head = slots[l][(current >> (l * SLOT_BITS)) & SLOT_MASK];
+            TimerNode* node = head;
+            head = nullptr;
+            while (node) {
+                TimerNode* next = node->next;
+                link(node);
+                node = next;
+            }
+        }
+        TimerNode*& head = slots[0][current & SLOT_MASK];
+        while (head) {
+            TimerNode* node = head;
+            head = node->next;
+            node->slot = nullptr;
+            node->prev = nullptr;
+            node->next = nullptr;
+            --pending;
+            fired->emplace_back(std::move(node->self));
+        }
+        ++current;
+    }
+
+    /**
+     * Number of ticks from the current tick to the next one worth waking up for: a tick with
+     * expiring timers or the next cascade.
+     */
+    uint64_t ticks_to_next_event() const {
+        uint64_t offset = current & SLOT_MASK;
+        for (uint64_t i = 0; i < SLOTS - offset; ++i) {
+            if (slots[0][offset + i]) {
+                return i;
+            }
+        }
+        return SLOTS - offset;
+    }
+
+    /**
+     * Unlink all timers, returning them in no particular order.
+     */
+    void clear(std::vector<std::shared_ptr<TimerNode>>* removed = nullptr) {
+        for (int l = 0; l < LEVELS; ++l) {
+            for (uint64_t s = 0; s < SLOTS; ++s) {
+                TimerNode* node = slots[l][s];
+                slots[l][s] = nullptr;
+                while (node) {
+                    TimerNode* next = node->next;
+                    node->slot = nullptr;
+                    node->prev = nullptr;
+                    node->next = nullptr;
+                    if (removed) {
+                        removed->emplace_back(std::move(node->self));
+                    } else {
+                        node->self.reset();
+                    }
+                    node = next;
+                }
+            }
+        }
+        pending = 0;
+    }
+
+    uint64_t current_tick() const noexcept {
+        return current;
+    }
+
+    size_t size() const noexcept {
+        return pending;
+    }
+
+private:
+    void link(TimerNode* node) {
+        uint64_t delta = node->expires - current;
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= (SLOTS << (level * SLOT_BITS))) {
+            ++level;
+        }
+        uint64_t expires = node->expires;
+        if (level == LEVELS - 1 && delta >= (SLOTS << (level * SLOT_BITS))) {
+            // Beyond the range of the wheel, park in the furthest slot and re-sort from there
+            expires = current + (SLOTS << (level * SLOT_BITS)) - 1;
+        }
+        TimerNode*& head = slots[level][(expires >> (level * SLOT_BITS)) & SLOT_MASK];
+        node->slot = &head;
+        node->prev = nullptr;
+        node->next = head;
+        if (head) {
+            head->prev = node;
+        }
+        head = node;
+    }
+
+    void unlink(TimerNode* node) {
+        if (node->prev) {
+            node->prev->next = node->next;
+        } else {
+            *node->slot = node->next;
+        }
+        if (node->next) {
+            node->next->prev = node->prev;
+        }
+        node->slot = nullptr;
+        node->prev = nullptr;
+        node->next = nullptr;
+    }
+
+    TimerNode* slots[LEVELS][SLOTS];
+    uint64_t current = 0;
+    size_t pending = 0;
+};
+
+/**
+ * Timer wheel and the lock guarding it, shared with the timers so that cancelling one through
+ * its handle stays safe after the executor is gone.
+ */
+struct TimerQueue {
+    std::mutex lock;
+    TimerWheel wheel;
+};
+
+} // namespace detail
+
+/**
+ * Handle of a task scheduled on a ScheduledThreadPoolExecutor.
+ */
+class ScheduledTask {
+public:
+    ScheduledTask() noexcept = default;
+
+    /**
+     * Cancel the task. A task that has not started will not run, and a periodic task will not run
+     * again. A run already in progress is not interrupted.
+     * Returns false if the task had already completed or been cancelled.
+     */
+    bool cancel();
+
+    bool is_cancelled() const noexcept {
+        return node && node->state.load() == detail::TimerNode::CANCELLED;
+    }
+
+    /**
+     * Returns true if the task has completed, been cancelled, or, if periodic, stopped because
+     * a run threw an exception.
+     */
+    bool is_done() const noexcept {
+        return node && node->state.load() >= detail::TimerNode::DONE;
+    }
+
+private:
+    friend class ScheduledThreadPoolExecutor;
+
+    explicit ScheduledTask(std::shared_ptr<detail::TimerNode> node) noexcept:
+    node(std::move(node)) {
+    }
+
+    std::shared_ptr<detail::TimerNode> node;
+};
+
+/**
+ * A thread pool executor that can also run tasks after a delay or periodically. Pending tasks
+ * are kept in a hierarchical timer wheel driven by one timer thread, which hands all tasks
+ * expiring in a tick to the pool with a single execute_bulk() call.
+ * Shutting down cancels all pending scheduled tasks, including periodic ones.
+ * Expired tasks go through the rejection policy of the pool like any others. Tasks that a full
+ * queue rejects or DISCARD_OLDEST drops fire again on the next tick. With BLOCK the timer thread
+ * waits for room, and with CALLER_RUNS tasks that do not fit run on the timer thread, delaying
+ * other timers in both cases.
+ */
+class ScheduledThreadPoolExecutor : public ThreadPoolExecutor {
+public:
+    template<class Rep = std::chrono::milliseconds::rep,
+            class Period = std::chrono::milliseconds::period>
+    ScheduledThreadPoolExecutor(size_t core_pool_size,
+                                size_t max_pool_size,
+                                std::chrono::nanoseconds::rep timeout_nanoseconds,
+                                const ThreadPoolOptions& options = ThreadPoolOptions(),
+                                const std::chrono::duration<Rep, Period>& tick =
+                                        std::chrono::milliseconds(1)) :
+            ThreadPoolExecutor(core_pool_size, max_pool_size, timeout_nanoseconds, options),
+                    tick(std::chrono::duration_cast<std::chrono::steady_clock::duration>(tick)),
+                    start_time(std::chrono::steady_clock::now()),
+                    timers(std::make_shared<detail::TimerQueue>()), stopped(false) {
+        timer_thread = std::thread(&ScheduledThreadPoolExecutor::run_timer, this);
+    }
+
+    ~ScheduledThreadPoolExecutor() {
+        shutdown();
+        // Queued expiries use the timer queue, which goes before the base class
+        await_termination();
+    }
+
+    /**
+     * Runs the callable with its parameters once after the delay.
+     */
+    template<class Rep, class Period, class Callable, class ... Args>
+    ScheduledTask schedule(const std::chrono::duration<Rep, Period>& delay, Callable&& c,
+                           Args&&... args) {
+        return schedule0(detail::TimerNode::Kind::ONE_SHOT, delay, 0,
+                std::bind(std::forward<Callable>(c), std::forward<Args>(args)...));
+    }
+
+    /**
+     * Runs the callable after initial_delay and then every period, measured from the scheduled
+     * start of the previous run. A run that is late delays later runs but never overlaps them.
+     * If a run throws, the task is not run again.
+     */
+    template<class Rep1, class Period1, class Rep2, class Period2, class Callable,
+            class ... Args>
+    ScheduledTask schedule_at_fixed_rate(const std::chrono::duration<Rep1, Period1>& initial_delay,
+                                         const std::chrono::duration<Rep2, Period2>& period,
+                                         Callable&& c, Args&&... args) {
+        return schedule0(detail::TimerNode::Kind::FIXED_RATE, initial_delay, to_ticks(period),
+                std::bind(std::forward<Callable>(c), std::forward<Args>(args)...));
+    }
+
+    /**
+     * Runs the callable after initial_delay and then again delay after each run finishes.
+     * If a run throws, the task is not run again.
+     */
+    template<class Rep1, class Period1, class Rep2, class Period2, class Callable,
+            class ... Args>
+    ScheduledTask schedule_with_fixed_delay(
+            const std::chrono::duration<Rep1, Period1>& initial_delay,
+            const std::chrono::duration<Rep2, Period2>& delay, Callable&& c, Args&&... args) {
+        return schedule0(detail::TimerNode::Kind::FIXED_DELAY, initial_delay, to_ticks(delay),
+                std::bind(std::forward<Callable>(c), std::forward<Args>(args)...));
+    }
+
+    /**
+     * Cancel all pending scheduled tasks, stop the timer thread and shut down the pool.
+     */
+    void shutdown() {
+        std::vector<std::shared_ptr<detail::TimerNode>> removed;
+        {
+            std::lock_guard<std::mutex> lock(timers->lock);
+            if (!stopped) {
+                stopped = true;
+                timers->wheel.clear(&removed);
+            }
+        }
+        timer_cv.notify_all();
+        for (auto& node : removed) {
+            node->state.store(detail::TimerNode::CANCELLED);
+        }
+        if (timer_thread.joinable() && timer_thread.get_id() != std::this_thread::get_id()) {
+            timer_thread.join();
+        }
+        ThreadPoolExecutor::shutdown();
+    }
+
+    /**
+     * Return number of scheduled tasks waiting for their time to come.
+     */
+    size_t get_scheduled_count() {
+        std::lock_guard<std::mutex> lock(timers->lock);
+        return timers->wheel.size();
+    }
+
+private:
+    /**
+     * Pool task running one expiry of a timer. One destroyed without having run was rejected or
+     * dropped by the pool, and hands its timer back to the wheel.
+     */
+    struct FireTask {
+        FireTask(ScheduledThreadPoolExecutor* exec, std::shared_ptr<detail::TimerNode> node) :
+                exec(exec), node(std::move(node)) {
+        }
+
+        FireTask(FireTask&& other) noexcept:
+        exec(other.exec), node(std::move(other.node)), ran(other.ran) {
+        }
+
+        ~FireTask() {
+            if (node && !ran) {
+                exec->refire(node);
+            }
+        }
+
+        void operator()() {
+            ran = true;
+            int expected = detail::TimerNode::SCHEDULED;
+            if (!node->state.compare_exchange_strong(expected, detail::TimerNode::RUNNING)) {
+                return; // cancelled
+            }
+            bool failed = false;
+            try {
+                node->task();
+            } catch (...) {
+                failed = true;
+            }
+            expected = detail::TimerNode::RUNNING;
+            if (node->kind == detail::TimerNode::Kind::ONE_SHOT || failed ||
+                    !exec->reschedule(node)) {
+                node->state.compare_exchange_strong(expected, detail::TimerNode::DONE);
+            }
+        }
+
+        ScheduledThreadPoolExecutor* exec;
+        std::shared_ptr<detail::TimerNode> node;
+        bool ran = false;
+    };
+
+    template<class Rep, class Period>
+    uint64_t to_ticks(const std::chrono::duration<Rep, Period>& d) const {
+        auto ns = std::chrono::duration_cast<std::chrono::steady_clock::duration>(d);
+        if (ns.count() <= 0) {
+            return 0;
+        }
+        return static_cast<uint64_t>((ns.count() + tick.count() - 1) / tick.count());
+    }
+
+    uint64_t now_tick() const {
+        return static_cast<uint64_t>((std::chrono::steady_clock::now() - start_time) / tick);
+    }
+
+    /**
+     * First tick at or after the given delay from now, so that tasks never run early.
+     */
+    uint64_t deadline_tick(std::chrono::steady_clock::duration delay) const {
+        auto since_start = std::chrono::steady_clock::now() - start_time;
+        if (delay.count() > 0) {
+            since_start += delay;
+        }
+        return static_cast<uint64_t>((since_start.count() + tick.count() - 1) / tick.count());
+    }
+
+    template<class Rep, class Period, class Runnable>
+    ScheduledTask schedule0(detail::TimerNode::Kind kind,
+                            const std::chrono::duration<Rep, Period>& delay,
+                            uint64_t period_ticks, Runnable&& r) {
+        if (is_shutdown()) {
+            throw(std::system_error(std::make_error_code(std::errc::permission_denied)));
+        }
+        if (kind != detail::TimerNode::Kind::ONE_SHOT && period_ticks == 0) {
+            period_ticks = 1;
+        }
+        auto node = std::make_shared<detail::TimerNode>(UniqueTask(std::forward<Runnable>(r)),
+                kind, period_ticks, timers);
+        uint64_t expires = deadline_tick(
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay));
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(timers->lock);
+            if (stopped) {
+                throw(std::system_error(std::make_error_code(std::errc::permission_denied)));
+            }
+            wake = expires < wakeup_tick;
+            timers->wheel.insert(node, expires);
+        }
+        if (wake) {
+            timer_cv.notify_one();
+        }
+        return ScheduledTask(std::move(node));
+    }
+
+    /**
+     * Put a periodic task back into the wheel after a run. Returns false if the executor no
+     * longer accepts scheduled tasks.
+     */
+    bool reschedule(const std::shared_ptr<detail::TimerNode>& node) {
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(timers->lock);
+            if (stopped) {
+                return false;
+            }
+            uint64_t expires = node->kind == detail::TimerNode::Kind::FIXED_RATE ?
+                    node->expires + node->period_ticks :
+                    deadline_tick(tick * static_cast<std::chrono::steady_clock::rep>(
+                            node->period_ticks));
+            // Re-arm before releasing the lock, so that cancel() either sees RUNNING and
+            // leaves the timer to us or sees SCHEDULED and removes it from the wheel.
+            int expected = detail::TimerNode::RUNNING;
+            if (!node->state.compare_exchange_strong(expected, detail::TimerNode::SCHEDULED)) {
+                return true; // cancelled while running
+            }
+            wake = expires < wakeup_tick;
+            timers->wheel.insert(node, expires);
+        }
+        if (wake) {
+            timer_cv.notify_one();
+        }
+        return true;
+    }
+
+    /**
+     * Put a timer whose expiry the pool did not accept back into the wheel for the next tick,
+     * or cancel it if the pool has been shut down.
+     */
+    void refire(const std::shared_ptr<detail::TimerNode>& node) {
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(timers->lock);
+            // Checked under the lock, so that cancel() either sees the timer back in the wheel
+            // or has already marked it
+            if (node->state.load() != detail::TimerNode::SCHEDULED) {
+                return;
+            }
+            if (stopped || is_shutdown()) {
+                node->state.store(detail::TimerNode::CANCELLED);
+                return;
+            }
+            uint64_t expires = timers->wheel.current_tick();
+            wake = expires < wakeup_tick;
+            timers->wheel.insert(node, expires);
+        }
+        if (wake) {
+            timer_cv.notify_one();
+        }
+    }
+
+    void run_timer() {
+        std::vector<std::shared_ptr<detail::TimerNode>> fired;
+        detail::TimerWheel& wheel = timers->wheel;
+        std::unique_lock<std::mutex> lock(timers->lock);
+        while (!stopped) {
+            uint64_t now = now_tick();
+            while (wheel.current_tick() <= now) {
+                wheel.advance(&fired);
+            }
+            if (!fired.empty()) {
+                lock.unlock();
+                submit_fired(&fired);
+                lock.lock();
+                continue;
+            }
+            if (wheel.size() == 0) {
+                wakeup_tick = UINT64_MAX;
+                timer_cv.wait(lock);
+            } else {
+                wakeup_tick = wheel.current_tick() + wheel.ticks_to_next_event();
+                auto ticks = static_cast<std::chrono::steady_clock::rep>(wakeup_tick);
+                timer_cv.wait_until(lock, start_time + tick * ticks);
+            }
+            wakeup_tick = 0;
+        }
+    }
+
+    void submit_fired(std::vector<std::shared_ptr<detail::TimerNode>>* fired) {
+        std::vector<FireTask> tasks;
+        tasks.reserve(fired->size());
+        for (auto& node : *fired) {
+            tasks.emplace_back(this, std::move(node));
+        }
+        fired->clear();
+        try {
+            execute_bulk(std::make_move_iterator(tasks.begin()),
+                    std::make_move_iterator(tasks.end()));
+        } catch (std::system_error&) {
+            // Tasks the pool did not take refire or, if it has been shut down directly through
+            // the base class, cancel as they are destroyed
+        }
+    }
+
+    const std::chrono::steady_clock::duration tick;
+    const std::chrono::steady_clock::time_point start_time;
+
+    std::shared_ptr<detail::TimerQueue> timers;
+    std::condition_variable timer_cv;
+    // Fields below are protected by the lock of timers
+    // Tick the timer thread is sleeping until, schedulers only need to wake it for earlier ones
+    uint64_t wakeup_tick = 0;
+    bool stopped;
+    std::thread timer_thread;
+};
+
+inline bool ScheduledTask::cancel() {
+    if (!node) {
+        return false;
+    }
+    // Completed tasks stay DONE
+    int prev = node->state.load();
+    while ((prev == detail::TimerNode::SCHEDULED || prev == detail::TimerNode::RUNNING) &&
+            !node->state.compare_exchange_weak(prev, detail::TimerNode::CANCELLED)) {
+    }
+    if (prev == detail::TimerNode::SCHEDULED) {
+        // Unlink it unless it has already been taken out of the wheel to fire
+        std::shared_ptr<detail::TimerQueue> timers = node->queue.lock();
+        if (timers) {
+            std::lock_guard<std::mutex> lock(timers->lock);
+            timers->wheel.remove(node.get());
+        }
+    }
+    return prev == detail::TimerNode::SCHEDULED || prev == detail::TimerNode::RUNNING;
+}
+
+/**
+ * Construct a scheduled thread pool with a fixed number of threads.
+ */
+std::unique_ptr<ScheduledThreadPoolExecutor> make_scheduled_thread_pool(size_t num_threads) {
+    return conc11::make_unique<ScheduledThreadPoolExecutor>(num_threads, num_threads, 0L);
+}
+
+} // namespace conc11
+
+#endif /* CONCURRENCY_SCHEDULED_EXECUTOR_H_ */
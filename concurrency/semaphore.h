@@ -8,15 +8,27 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
-#include <map>
 #include <memory>
 #include <mutex>
 #include <type_traits>
+#if defined(__linux__)
+#include <cerrno>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "../util/bits/parker.h"
 
 namespace conc11 {
 
 /**
- * A fair semaphore with an internal waiting queue.
+ * A fair semaphore with an internal waiting queue. While no thread waits, acquire and release
+ * only update the atomic permit count and do not take main_lock. Otherwise release hands the
+ * permits directly to the waiters at the head of the queue, in order and as long as their
+ * requests fit, and wakes only those, so a woken thread never has to wait again.
+ * Waiting threads link a node on their own stack into the queue and park on their thread's
+ * Parker, so the semaphore has a fixed size and blocking allocates nothing.
  */
 template<class LockType>
 class QueuedSemaphore {
@@ -26,7 +38,7 @@ public:
     }
 
     explicit QueuedSemaphore(int initial_permits) :
-            permits(initial_permits) {
+            permits(initial_permits), waiters(0) {
     }
 
     QueuedSemaphore(const QueuedSemaphore&) = delete;
@@ -47,11 +59,14 @@ public:
     }
 
     void release(unsigned int request) {
-        std::lock_guard<LockType> lock(main_lock);
-        permits += request;
-        if (permits >= request_record_min()) {
-            queue.wake_head();
+        // Pairs with the increment of waiters in try_acquire0(): either this sees the waiter, or
+        // the waiter sees the released permits before it goes to sleep.
+        permits.fetch_add(request);
+        if (waiters.load() == 0) {
+            return;
         }
+        std::lock_guard<LockType> lock(main_lock);
+        grant_locked();
     }
 
     /**
@@ -62,13 +77,7 @@ public:
     }
 
     bool try_acquire(unsigned int request) {
-        std::lock_guard<LockType> lock(main_lock);
-        if (permits >= request) {
-            permits -= request;
-            return true;
-        } else {
-            return false;
-        }
+        return take_permits(request);
     }
 
     bool try_acquire_for(unsigned long millis, unsigned int micros) {
@@ -96,13 +105,13 @@ public:
 
     template<class Clock, class Duration>
     bool try_acquire_until(const std::chrono::time_point<Clock, Duration> &timeout_time) {
-        return try_acquire_until(1, &timeout_time);
+        return try_acquire_until(1, timeout_time);
     }
 
     template<class Clock, class Duration>
     bool try_acquire_until(unsigned int request,
                            const std::chrono::time_point<Clock, Duration> &timeout_time) {
-        return try_acquire0(true, &timeout_time);
+        return try_acquire0(true, request, &timeout_time);
     }
 
     int available_permits() const noexcept {
@@ -111,86 +120,51 @@ public:
 
 private:
     struct WaitNode {
-        typename std::conditional<std::is_same<LockType, std::mutex>::value,
-                std::condition_variable,
-                std::condition_variable_any>::type cv;
-        bool wakeable = false;
+        WaitNode(unsigned int request, Parker& parker) :
+                request(request), parker(parker) {
+        }
+
+        const unsigned int request;
+        Parker& parker;
+        // Set once the permits have been taken on behalf of the waiting thread. Written under
+        // both main_lock and the parker's mutex, read under either.
+        bool granted = false;
         WaitNode *prev = nullptr;
         WaitNode *next = nullptr;
     };
 
     /**
-     * Implementation of the thread waiting queue, a cached linked list of waiting nodes. This
-     * class is not thread safe and should be protected by the outer semaphore.
+     * Implementation of the thread waiting queue, an intrusive doubly linked list of nodes owned
+     * by the waiting threads. This class is not thread safe and should be protected by the outer
+     * semaphore.
      */
     class WaitQueue {
     public:
-
         WaitQueue() {
-            alloc_cache();
-        }
-
-        ~WaitQueue() {
-            while (head) {
-                WaitNode *next = head->next;
-                delete head;
-                head = next;
-            }
-            while (cache_head) {
-                WaitNode *next = cache_head->next;
-                delete cache_head;
-                cache_head = next;
-            }
         }
 
         WaitQueue(const WaitQueue &) = delete;
         WaitQueue &operator=(const WaitQueue &) = delete;
 
         /**
-         * Enqueue a waiting node at the tail and return a pointer to it.
-         * May cause memory allocation when cached wait nodes are depleted.
+         * Link a waiting node at the tail.
          */
-        WaitNode *enqueue() {
-            if (!cache_head) {
-                alloc_cache();
-                cur_queue_capacity <<= 1;
-            }
-            WaitNode *cur = cache_head;
-            cache_head = cache_head->next;
-
-            cur->wakeable = false;
-            // cur->prev = nullptr; // already guaranteed
-            cur->next = nullptr;
+        void enqueue(WaitNode *node) {
             if (!tail) {
-                head = cur;
-                tail = cur;
+                head = node;
+                tail = node;
             } else {
-                tail->next = cur;
-                cur->prev = tail;
-                tail = cur;
+                tail->next = node;
+                node->prev = tail;
+                tail = node;
             }
-            return cur;
         }
 
         /**
-         * Dequeue WaitNode at head of the queue, returning it to the cache.
-         */
-        void dequeue() {
-            remove(head);
-        }
-
-        /**
-         * Remove a WaitNode from the queue and return it to the cache. Undefined behaviour if node is
-         * not already in the queue. Do nothing if node is nullptr.
+         * Unlink a WaitNode from the queue. Undefined behaviour if node is not already in the
+         * queue.
          */
         void remove(WaitNode *node) {
-            if (!node) {
-                return;
-            }
-            if (node == head && head == tail) {
-                head = nullptr;
-                tail = nullptr;
-            } // handle special condition in which the last node is removed from the queue
             if (node == head) {
                 head = node->next;
             }
@@ -203,21 +177,12 @@ private:
             if (node->next) {
                 node->next->prev = node->prev;
             }
-
             node->prev = nullptr;
-            node->next = cache_head;
-            cache_head = node;
+            node->next = nullptr;
         }
 
-        /**
-         * Wake the thread waiting at head of the queue.
-         */
-        void wake_head() {
-            if (!head) {
-                return;
-            }
-            head->wakeable = true;
-            head->cv.notify_all();
+        WaitNode *front() {
+            return head;
         }
 
         bool is_empty() {
@@ -225,122 +190,90 @@ private:
         }
 
         int num_waiting_nodes() {
-            if (!head) {
-                return 0;
-            } else {
-                int ctr = 0;
-                WaitNode *p = head;
-                while (p) {
-                    ctr += 1;
-                    p = p->next;
-                }
-                return ctr;
+            int ctr = 0;
+            for (WaitNode *p = head; p; p = p->next) {
+                ctr += 1;
             }
+            return ctr;
         }
 
     private:
-
-        void alloc_cache() {
-            for (size_t i = 0; i < cur_queue_capacity; ++i) {
-                WaitNode *cur = new WaitNode();
-                cur->next = cache_head;
-                cache_head = cur;
-            }
-        }
-
-        // Doubly linked list as the waiting queue
         WaitNode *head = nullptr;
         WaitNode *tail = nullptr;
-
-        // **Forward** linked list of cached nodes
-        WaitNode *cache_head = nullptr;
-
-        size_t cur_queue_capacity = 256;
     };
 
     template<class Clock, class Duration>
     bool try_acquire0(bool timed, unsigned int request,
                       const std::chrono::time_point<Clock, Duration> *timeout_time) {
+        // Fast path: nobody waits, so taking permits cannot overtake a queued thread.
+        if (waiters.load() == 0 && take_permits(request)) {
+            return true;
+        }
+
         std::unique_lock<LockType> lock(main_lock);
-//        printf("permits before acquire: %d\n", permits);
-        if (permits >= (int) request && queue.is_empty()) {
-            permits -= request;
+        waiters.fetch_add(1);
+        if (queue.is_empty() && take_permits(request)) {
+            waiters.fetch_sub(1);
             return true;
         }
 
-        request_record_insert(request);
+        WaitNode node(request, Parker::current());
+        queue.enqueue(&node);
+        lock.unlock();
+        auto is_granted = [&node]() {return node.granted;};
         if (!timed) {
-            while (true) {
-                WaitNode *wait_node = queue.enqueue();
-                wait_node->cv.wait(lock, [wait_node]() {return wait_node->wakeable;});
-                queue.dequeue();
-                if (permits >= (int) request) {
-                    break;
-                }
-            }
-        } else {
-            while (true) {
-                WaitNode *wait_node = queue.enqueue();
-                bool timeout = !(wait_node->cv.wait_until(lock, *timeout_time,
-                        [wait_node]() {return wait_node->wakeable;}));
-                if (timeout) {
-                    queue.remove(wait_node);
-                    return false;
-                }
-                queue.dequeue();
-                if (permits >= (int) request) {
-                    break;
-                }
-            }
+            node.parker.park(is_granted);
+            return true;
         }
-        request_record_remove(request);
-
-        // When control reaches here current thread is at the head of the queue and
-        // permits are enough
-        permits -= request;
-        if (permits >= request_record_min()) {
-            queue.wake_head(); // propogate waking signal if there are permits left now
+        if (node.parker.park_until(*timeout_time, is_granted)) {
+            return true;
         }
-        if (permits < 0) {
-            printf("BOOM!");
-            std::terminate(); // BOOM when something went very wrong. Will be removed later.
+        lock.lock();
+        if (node.granted) {
+            return true; // granted between the timeout and taking main_lock
         }
-
-        return true;
+        queue.remove(&node);
+        waiters.fetch_sub(1);
+        // The requests behind a large one that gave up may fit now
+        grant_locked();
+        return false;
     }
 
-    void request_record_insert(unsigned int request) {
-        auto iter = request_record.find(request);
-        if (iter != request_record.end()) {
-            iter->second += 1;
-        } else {
-            request_record.emplace(request, 1);
+    /**
+     * Hand permits to the waiters at the head of the queue for as long as their requests fit,
+     * removing and waking each of them. The permits are taken on their behalf, so that a woken
+     * thread returns at once.
+     */
+    void grant_locked() {
+        WaitNode *node;
+        while ((node = queue.front()) && take_permits(node->request)) {
+            queue.remove(node);
+            waiters.fetch_sub(1);
+            // The node lives on the stack of its thread, which may return as soon as it sees
+            // granted, so it must not be touched after unpark().
+            node->parker.unpark([node]() {node->granted = true;});
         }
     }
 
-    void request_record_remove(unsigned int request) {
-        auto iter = request_record.find(request);
-        if (iter != request_record.end()) {
-            if (iter->second == 1) {
-                request_record.erase(iter);
-            } else {
-                iter->second -= 1;
+    /**
+     * Take request permits if there are enough, without blocking.
+     */
+    bool take_permits(unsigned int request) {
+        int available = permits.load();
+        while (available >= (int) request) {
+            if (permits.compare_exchange_weak(available, available - (int) request)) {
+                return true;
             }
         }
-    }
-
-    int request_record_min() {
-        if (request_record.begin() != request_record.end()) {
-            return request_record.begin()->first;
-        } else {
-            return 0;
-        }
+        return false;
     }
 
     std::atomic_int permits = 0;
+    // Threads in the slow path of acquire that have not been granted permits yet, counted under
+    // main_lock
+    std::atomic_int waiters;
     LockType main_lock;
     WaitQueue queue;
-    std::map<unsigned int, std::size_t> request_record;
 };
 
 /**
@@ -427,7 +360,7 @@ public:
     template<class Clock, class Duration>
     bool try_acquire_until(unsigned int request,
                            const std::chrono::time_point<Clock, Duration> &timeout_time) {
-        return try_acquire0(true, timeout_time);
+        return try_acquire0(request, timeout_time);
     }
 
     int available_permits() const noexcept {
@@ -455,6 +388,174 @@ private:
     std::atomic_int count;
 };
 
+#if defined(__linux__)
+/**
+ * An unfair semaphore for Linux that keeps its permit count in a futex word and lets blocked
+ * threads sleep on the count itself. A block and wake cycle costs one futex system call on each
+ * side, and release does not enter the kernel at all while no thread waits. Releasing n permits
+ * wakes at most n threads, as each waiter needs at least one permit. A woken thread whose
+ * request is still too large passes the wake-up on to the next sleeper, once for every increase
+ * of the count it observes, so that weighted requests behind it are not stranded.
+ */
+class FutexSemaphore {
+public:
+    FutexSemaphore() :
+            FutexSemaphore(0) {
+    }
+
+    explicit FutexSemaphore(int initial_permits) :
+            count(initial_permits), waiters(0) {
+    }
+
+    FutexSemaphore(const FutexSemaphore&) = delete;
+    FutexSemaphore& operator=(const FutexSemaphore&) = delete;
+
+    void acquire() {
+        acquire(1);
+    }
+
+    void acquire(unsigned int request) {
+        wait_for_permits(request, nullptr);
+    }
+
+    void release() {
+        release(1);
+    }
+
+    void release(unsigned int request) {
+        // Pairs with the increment of waiters in wait_for_permits(): either this sees the
+        // waiter, or the waiter sees the new count, if not before then in the kernel's check of
+        // the futex word.
+        count.fetch_add((int) request);
+        if (waiters.load() > 0) {
+            futex_wake((int) request);
+        }
+    }
+
+    bool try_acquire() {
+        return try_acquire(1);
+    }
+
+    bool try_acquire(unsigned int request) {
+        int available = count.load();
+        return take_permits(request, available);
+    }
+
+    bool try_acquire_for(unsigned long millis, unsigned int micros) {
+        return try_acquire_for(1, millis, micros);
+    }
+
+    bool try_acquire_for(unsigned int request, unsigned long millis, unsigned int micros) {
+        std::chrono::steady_clock::time_point timeout_time = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(millis) + std::chrono::microseconds(micros);
+        return wait_for_permits(request, &timeout_time);
+    }
+
+    template<class Rep, class Period>
+    bool try_acquire_for(const std::chrono::duration<Rep, Period>& timeout_duration) {
+        return try_acquire_for(1, timeout_duration);
+    }
+
+    template<class Rep, class Period>
+    bool try_acquire_for(unsigned int request,
+                         const std::chrono::duration<Rep, Period>& timeout_duration) {
+        std::chrono::steady_clock::time_point timeout_time = std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout_duration);
+        return wait_for_permits(request, &timeout_time);
+    }
+
+    template<class Clock, class Duration>
+    bool try_acquire_until(const std::chrono::time_point<Clock, Duration> &timeout_time) {
+        return try_acquire_until(1, timeout_time);
+    }
+
+    template<class Clock, class Duration>
+    bool try_acquire_until(unsigned int request,
+                           const std::chrono::time_point<Clock, Duration> &timeout_time) {
+        return try_acquire_for(request, timeout_time - Clock::now());
+    }
+
+    int available_permits() const noexcept {
+        return count.load();
+    }
+
+private:
+    static_assert(sizeof(std::atomic_int) == sizeof(int),
+            "the permit count must be usable as a futex word");
+
+    /**
+     * Take request permits if there are enough, starting from the observed count available,
+     * which is updated on failure.
+     */
+    bool take_permits(unsigned int request, int& available) {
+        while (available >= (int) request) {
+            if (count.compare_exchange_weak(available, available - (int) request)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool wait_for_permits(unsigned int request,
+                          const std::chrono::steady_clock::time_point* timeout_time) {
+        int available = count.load();
+        if (take_permits(request, available)) {
+            return true;
+        }
+        waiters.fetch_add(1);
+        available = count.load();
+        int last_seen = available;
+        bool acquired = true;
+        while (!take_permits(request, available)) {
+            if (available > last_seen) {
+                futex_wake(1); // permits arrived that this thread cannot use
+            }
+            last_seen = available;
+            if (!futex_wait(available, timeout_time)) {
+                available = count.load();
+                acquired = take_permits(request, available);
+                break;
+            }
+            available = count.load();
+        }
+        waiters.fetch_sub(1);
+        return acquired;
+    }
+
+    int* futex_word() noexcept {
+        return reinterpret_cast<int*>(&count);
+    }
+
+    /**
+     * Sleep while the count equals expected. Returns false if timeout_time, which is absolute on
+     * the monotonic clock that steady_clock reads, has passed.
+     */
+    bool futex_wait(int expected, const std::chrono::steady_clock::time_point* timeout_time) {
+        timespec ts;
+        timespec* pts = nullptr;
+        if (timeout_time) {
+            long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    timeout_time->time_since_epoch()).count();
+            ns = ns > 0 ? ns : 0;
+            ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+            ts.tv_nsec = static_cast<long>(ns % 1000000000);
+            pts = &ts;
+        }
+        long r = syscall(SYS_futex, futex_word(), FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG,
+                expected, pts, nullptr, FUTEX_BITSET_MATCH_ANY);
+        return r == 0 || errno != ETIMEDOUT;
+    }
+
+    void futex_wake(int n) {
+        syscall(SYS_futex, futex_word(), FUTEX_WAKE | FUTEX_PRIVATE_FLAG, n, nullptr, nullptr, 0);
+    }
+
+    std::atomic_int count;
+    // Threads in the slow path of acquire
+    std::atomic_int waiters;
+};
+#endif
+
 /**
  * A semaphore wrapper class that provides convenient RAII semaphore owning mechanism during a
  * scoped block. Note that this can also be achieved by using SemaphoreLock with a std::lock_guard
@@ -0,0 +1,373 @@
+/**
+ * spsc_ring.h
+ */
+#ifndef CONCURRENCY_SPSC_RING_H_
+#define CONCURRENCY_SPSC_RING_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include "../util/bits/cache_line.h"
+
+namespace conc11 {
+
+/**
+ * A bounded wait-free ring buffer for exactly one producer thread and one consumer thread, such
+ * as two stages of a pipeline. Every operation is a bounded number of plain loads and stores
+ * without compare-and-swap. Each side keeps its own index and a cached copy of the other side's
+ * index on its own cache line, and only rereads the other side's index when the cached copy
+ * says the ring is full or empty.
+ *
+ * The capacity is rounded up to a power of two. All slots hold constructed elements, so T must
+ * be default constructible, and popped slots are left moved from. Besides pushing and popping
+ * single elements or batches, the producer can fill slots in place with reserve() and commit(),
+ * and the consumer can read them in place with peek() and consume().
+ *
+ * With Blocking, push(), pop() and their batch and timed variants wait on a condition variable
+ * when the ring is full or empty, as Latch does. Every publishing operation then costs a memory
+ * fence to check for a waiting peer, which non-blocking rings do not pay.
+ */
+template<class T, bool Blocking = false>
+class SPSCRing {
+    static_assert(std::is_default_constructible<T>::value,
+            "SPSCRing elements must be default constructible");
+
+public:
+    explicit SPSCRing(std::size_t min_capacity) :
+            cap(round_up_capacity(min_capacity)), mask(cap - 1), slots(new T[cap]),
+                    head(0), tail_cache(0), tail(0), head_cache(0),
+                    consumer_waiting(false), producer_waiting(false) {
+    }
+
+    SPSCRing(const SPSCRing&) = delete;
+    SPSCRing& operator=(const SPSCRing&) = delete;
+
+    // Producer side
+
+    /**
+     * Push an element. Returns false and leaves value untouched if the ring is full.
+     */
+    bool try_push(T&& value) {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (free_slots(t) == 0) {
+            return false;
+        }
+        slots[t & mask] = std::move(value);
+        publish(t + 1);
+        return true;
+    }
+
+    bool try_push(const T& value) {
+        T copy(value);
+        return try_push(std::move(copy));
+    }
+
+    /**
+     * Push a prefix of [first, last) as one batch, assigning elements from *it, pass move
+     * iterators to move them. Returns the number of elements pushed, the rest are left untouched.
+     */
+    template<class ForwardIt>
+    std::size_t try_push_n(ForwardIt first, ForwardIt last) {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        std::size_t n = std::min(static_cast<std::size_t>(std::distance(first, last)),
+                free_slots(t));
+        for (std::size_t i = 0; i < n; ++i, ++first) {
+            slots[(t + i) & mask] = *first;
+        }
+        if (n > 0) {
+            publish(t + n);
+        }
+        return n;
+    }
+
+    /**
+     * Get up to max free slots to fill in place, contiguous from *first. Returns their number,
+     * which is smaller than the free space when the free slots wrap around the end of the ring.
+     * The slots hold moved from elements and are published by commit().
+     */
+    std::size_t reserve(T** first, std::size_t max) {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        std::size_t n = std::min(std::min(max, free_slots(t)), cap - (t & mask));
+        *first = &slots[t & mask];
+        return n;
+    }
+
+    /**
+     * Publish the first n slots returned by reserve().
+     */
+    void commit(std::size_t n) {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        assert(n <= cap - (t - head_cache));
+        if (n > 0) {
+            publish(t + n);
+        }
+    }
+
+    /**
+     * Push an element, waiting while the ring is full.
+     */
+    void push(T&& value) {
+        static_assert(Blocking, "push() needs a Blocking SPSCRing");
+        while (!try_push(std::move(value))) {
+            wait(producer_waiting, not_full_cv, [this]() {return !full();},
+                    std::chrono::steady_clock::time_point::max());
+        }
+    }
+
+    /**
+     * Push all of [first, last) in order, waiting while the ring is full.
+     */
+    template<class ForwardIt>
+    void push_n(ForwardIt first, ForwardIt last) {
+        static_assert(Blocking, "push_n() needs a Blocking SPSCRing");
+        while (first != last) {
+            std::size_t n = try_push_n(first, last);
+            if (n == 0) {
+                wait(producer_waiting, not_full_cv, [this]() {return !full();},
+                        std::chrono::steady_clock::time_point::max());
+            }
+            std::advance(first, n);
+        }
+    }
+
+    // Consumer side
+
+    /**
+     * Pop the oldest element into out. Returns false if the ring is empty.
+     */
+    bool try_pop(T* out) {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (ready_slots(h) == 0) {
+            return false;
+        }
+        *out = std::move(slots[h & mask]);
+        release(h + 1);
+        return true;
+    }
+
+    /**
+     * Pop up to n elements, assigning them to *out++ in order. Returns the number popped.
+     */
+    template<class OutputIt>
+    std::size_t try_pop_n(OutputIt out, std::size_t n) {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        n = std::min(n, ready_slots(h));
+        for (std::size_t i = 0; i < n; ++i, ++out) {
+            *out = std::move(slots[(h + i) & mask]);
+        }
+        if (n > 0) {
+            release(h + n);
+        }
+        return n;
+    }
+
+    /**
+     * Get up to max published elements to read in place, contiguous from *first. Returns their
+     * number, which is smaller than the ring size when the elements wrap around the end of the
+     * ring. The elements stay in the ring until consume().
+     */
+    std::size_t peek(T** first, std::size_t max) {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        std::size_t n = std::min(std::min(max, ready_slots(h)), cap - (h & mask));
+        *first = &slots[h & mask];
+        return n;
+    }
+
+    /**
+     * Free the first n elements returned by peek() for the producer to reuse.
+     */
+    void consume(std::size_t n) {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        assert(n <= tail_cache - h);
+        if (n > 0) {
+            release(h + n);
+        }
+    }
+
+    /**
+     * Pop the oldest element, waiting while the ring is empty.
+     */
+    void pop(T* out) {
+        static_assert(Blocking, "pop() needs a Blocking SPSCRing");
+        while (!try_pop(out)) {
+            wait(consumer_waiting, not_empty_cv, [this]() {return !empty();},
+                    std::chrono::steady_clock::time_point::max());
+        }
+    }
+
+    /**
+     * Pop like pop() but wait at most timeout_duration. Returns false on timeout.
+     */
+    template<class Rep, class Period>
+    bool pop_for(T* out, const std::chrono::duration<Rep, Period>& timeout_duration) {
+        static_assert(Blocking, "pop_for() needs a Blocking SPSCRing");
+        auto timeout_time = std::chrono::steady_clock::now() +
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout_duration);
+        while (!try_pop(out)) {
+            if (!wait(consumer_waiting, not_empty_cv, [this]() {return !empty();},
+                    timeout_time)) {
+                return try_pop(out);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Pop between 1 and n elements into *out++, waiting while the ring is empty. Returns the
+     * number popped.
+     */
+    template<class OutputIt>
+    std::size_t pop_n(OutputIt out, std::size_t n) {
+        static_assert(Blocking, "pop_n() needs a Blocking SPSCRing");
+        if (n == 0) {
+            return 0;
+        }
+        std::size_t popped;
+        while ((popped = try_pop_n(out, n)) == 0) {
+            wait(consumer_waiting, not_empty_cv, [this]() {return !empty();},
+                    std::chrono::steady_clock::time_point::max());
+        }
+        return popped;
+    }
+
+    // Either side
+
+    /**
+     * Returns true if the ring is observed empty. Approximate unless called by the consumer.
+     */
+    bool empty() const noexcept {
+        return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Returns true if the ring is observed full. Approximate unless called by the producer.
+     */
+    bool full() const noexcept {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire) == cap;
+    }
+
+    /**
+     * Returns number of elements in the ring. Approximate when called concurrently.
+     */
+    std::size_t size() const noexcept {
+        std::size_t h = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - h;
+    }
+
+    std::size_t capacity() const noexcept {
+        return cap;
+    }
+
+private:
+    static std::size_t round_up_capacity(std::size_t min_capacity) noexcept {
+        std::size_t c = 2;
+        while (c < min_capacity) {
+            c <<= 1;
+        }
+        return c;
+    }
+
+    /**
+     * Number of slots the producer may fill from index t, rereading head only if the cached
+     * copy shows none.
+     */
+    std::size_t free_slots(std::size_t t) {
+        std::size_t n = cap - (t - head_cache);
+        if (n == 0) {
+            head_cache = head.load(std::memory_order_acquire);
+            n = cap - (t - head_cache);
+        }
+        return n;
+    }
+
+    /**
+     * Number of elements the consumer may take from index h, rereading tail only if the cached
+     * copy shows none.
+     */
+    std::size_t ready_slots(std::size_t h) {
+        std::size_t n = tail_cache - h;
+        if (n == 0) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            n = tail_cache - h;
+        }
+        return n;
+    }
+
+    void publish(std::size_t t) {
+        tail.store(t, std::memory_order_release);
+        wake(consumer_waiting, not_empty_cv);
+    }
+
+    void release(std::size_t h) {
+        head.store(h, std::memory_order_release);
+        wake(producer_waiting, not_full_cv);
+    }
+
+    /**
+     * Wake the peer if it announced that it is waiting. The fence pairs with the one in wait():
+     * either the peer sees the index just stored, or this sees its flag.
+     */
+    void wake(std::atomic<bool>& waiting, std::condition_variable& cv) {
+        if (!Blocking) {
+            return;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            cv.notify_one();
+        }
+    }
+
+    /**
+     * Wait until ready() or timeout_time. Returns false on timeout.
+     */
+    template<class Ready>
+    bool wait(std::atomic<bool>& waiting, std::condition_variable& cv, Ready ready,
+              std::chrono::steady_clock::time_point timeout_time) {
+        std::unique_lock<std::mutex> lock(mtx);
+        waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ok = true;
+        if (timeout_time == std::chrono::steady_clock::time_point::max()) {
+            cv.wait(lock, ready);
+        } else {
+            ok = cv.wait_until(lock, timeout_time, ready);
+        }
+        waiting.store(false, std::memory_order_relaxed);
+        return ok;
+    }
+
+    const std::size_t cap;
+    const std::size_t mask;
+    std::unique_ptr<T[]> slots;
+
+    // Written by the consumer. Padded so that the producer's line is never shared with it.
+    char pad0[CACHE_LINE_SIZE];
+    std::atomic<std::size_t> head;
+    std::size_t tail_cache;
+    char pad1[CACHE_LINE_SIZE - sizeof(std::atomic<std::size_t>) - sizeof(std::size_t)];
+
+    // Written by the producer.
+    std::atomic<std::size_t> tail;
+    std::size_t head_cache;
+    char pad2[CACHE_LINE_SIZE - sizeof(std::atomic<std::size_t>) - sizeof(std::size_t)];
+
+    // Only used with Blocking.
+    std::atomic<bool> consumer_waiting;
+    std::atomic<bool> producer_waiting;
+    std::mutex mtx;
+    std::condition_variable not_empty_cv;
+    std::condition_variable not_full_cv;
+};
+
+} // namespace conc11
+
+#endif /* CONCURRENCY_SPSC_RING_H_ */
@@ -0,0 +1,225 @@
+/**
+ * strand.h
+ */
+#ifndef CONCURRENCY_STRAND_H_
+#define CONCURRENCY_STRAND_H_
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include "executor.h"
+#include "future.h"
+#include "../util/util.h"
+
+namespace conc11 {
+
+/**
+ * Serial executor running its tasks one at a time in submission order on the threads of a
+ * ThreadPoolExecutor, such as all tasks of one session or account. A task submitted to a strand
+ * happens before the next task of the strand starts, so state touched only by the tasks of one
+ * strand needs no locking.
+ *
+ * A strand with pending tasks occupies one slot of the executor queue or one worker. The worker
+ * draining a strand runs up to batch_size of its tasks, then requeues the strand behind other
+ * work if more are pending. An idle strand holds no executor resources, so one strand per key is
+ * cheap. Tasks still pending when the strand is destroyed are run.
+ * If the executor rejects the drain of an idle strand, the task that found it idle is dropped
+ * along with any queued behind it meanwhile, their futures becoming broken promises, and the
+ * error is thrown to the submitter of that task. Under RejectionPolicy::CALLER_RUNS a worker
+ * that cannot requeue the strand carries on draining it. The executor must not use
+ * RejectionPolicy::DISCARD_OLDEST, which could drop the task draining a strand and leave the
+ * strand stalled.
+ */
+class Strand : public ExecutorBase {
+public:
+    static const size_t DEFAULT_BATCH_SIZE = 64;
+
+    explicit Strand(ThreadPoolExecutor& executor, size_t batch_size = DEFAULT_BATCH_SIZE) :
+            state(std::make_shared<State>(executor, batch_size > 0 ? batch_size : 1)) {
+    }
+
+    /**
+     * Submits a callable like ThreadPoolExecutor::submit(), to run after all tasks submitted to
+     * this strand before.
+     */
+    template<typename Callable, typename ... Args>
+    auto submit(Callable&& c, Args&&... args)
+    -> std::future<decltype(conc11::invoke(std::forward<Callable>(c),
+            std::forward<Args>(args)...))> {
+        using RetType = decltype(
+                conc11::invoke(std::forward<Callable>(c), std::forward<Args>(args)...));
+
+        std::packaged_task<RetType()> task(
+                std::bind(std::forward<Callable>(c), std::forward<Args>(args)...));
+        std::future<RetType> f = task.get_future();
+        state->enqueue(UniqueTask(std::move(task)));
+        return f;
+    }
+
+    /**
+     * Submits a callable like submit(), returning a conc11::Future.
+     */
+    template<typename Callable, typename ... Args>
+    auto async(Callable&& c, Args&&... args)
+    -> Future<decltype(conc11::invoke(std::forward<Callable>(c), std::forward<Args>(args)...))> {
+        using RetType = decltype(
+                conc11::invoke(std::forward<Callable>(c), std::forward<Args>(args)...));
+
+        Promise<RetType> promise;
+        Future<RetType> f = promise.get_future();
+        auto bind_obj = std::bind(std::forward<Callable>(c), std::forward<Args>(args)...);
+        state->enqueue(UniqueTask(PromiseTask<RetType, decltype(bind_obj)>(std::move(promise),
+                std::move(bind_obj))));
+        return f;
+    }
+
+    /**
+     * Submits a callable like ThreadPoolExecutor::execute(), to run after all tasks submitted to
+     * this strand before.
+     */
+    template<typename Callable, typename ... Args>
+    void execute(Callable&& c, Args&&... args) {
+        auto bind_obj = std::bind(std::forward<Callable>(c), std::forward<Args>(args)...);
+        state->enqueue(UniqueTask(UntrackableTask<decltype(bind_obj)>(std::move(bind_obj))));
+    }
+
+    /**
+     * Return number of tasks waiting for their turn, not counting a running one.
+     */
+    size_t get_pending_count() {
+        std::lock_guard<std::mutex> lock(state->lock);
+        return state->queue.size();
+    }
+
+    /**
+     * Returns true if called from a task of this strand.
+     */
+    bool running_in_this_thread() const noexcept {
+        return State::current() == state.get();
+    }
+
+    ThreadPoolExecutor& get_executor() noexcept {
+        return state->executor;
+    }
+
+private:
+    /**
+     * Shared with the drain task in the executor, so that pending tasks outlive the strand.
+     */
+    struct State : std::enable_shared_from_this<State> {
+        State(ThreadPoolExecutor& executor, size_t batch_size) :
+                executor(executor), batch_size(batch_size) {
+        }
+
+        /**
+         * Queue a task, scheduling a drain unless one is already scheduled or running.
+         */
+        void enqueue(UniqueTask&& task) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                queue.push(std::move(task));
+                if (scheduled) {
+                    return;
+                }
+                scheduled = true;
+            }
+            try {
+                schedule_drain();
+            } catch (...) {
+                // Tasks queued behind this one meanwhile were accepted on the strength of the
+                // drain, so they are rejected too. Destroy them outside the lock as that may
+                // complete promises with continuations.
+                RingQueue<UniqueTask> rejected;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    while (!queue.empty()) {
+                        rejected.push(std::move(queue.front()));
+                        queue.pop();
+                    }
+                    scheduled = false;
+                }
+                throw;
+            }
+        }
+
+        void schedule_drain() {
+            auto self = shared_from_this();
+            executor.execute([self]() {
+                if (current() == self.get()) {
+                    // Run by CALLER_RUNS in the thread requeueing the drain, which carries on
+                    self->requeue_refused = true;
+                    return;
+                }
+                self->drain();
+            });
+        }
+
+        /**
+         * Run queued tasks until the queue is empty, requeueing the drain after every batch_size
+         * tasks. Tasks never throw as they are wrapped.
+         */
+        void drain() {
+            State* outer = current();
+            current() = this;
+            size_t ran = 0;
+            while (true) {
+                UniqueTask task;
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (queue.empty()) {
+                        scheduled = false;
+                        break;
+                    }
+                    if (ran < batch_size) {
+                        task = std::move(queue.front());
+                        queue.pop();
+                    }
+                }
+                if (!task) {
+                    // Give the worker to other work. Enqueuers still see scheduled, so the new
+                    // drain is the only one. If the executor refuses, carry on here rather than
+                    // nesting drains on this stack.
+                    ran = 0;
+                    try {
+                        schedule_drain();
+                    } catch (std::system_error&) {
+                        continue;
+                    }
+                    if (requeue_refused) {
+                        requeue_refused = false;
+                        continue;
+                    }
+                    break;
+                }
+                task();
+                ++ran;
+            }
+            current() = outer;
+        }
+
+        /**
+         * The strand whose task the calling thread is running, or nullptr.
+         */
+        static State*& current() noexcept {
+            static thread_local State* state = nullptr;
+            return state;
+        }
+
+        ThreadPoolExecutor& executor;
+        const size_t batch_size;
+        std::mutex lock;
+        RingQueue<UniqueTask> queue;
+        // A drain is queued in the executor or running, protected by lock
+        bool scheduled = false;
+        // Only touched by the draining thread, see schedule_drain()
+        bool requeue_refused = false;
+    };
+
+    std::shared_ptr<State> state;
+};
+
+} // namespace conc11
+
+#endif /* CONCURRENCY_STRAND_H_ */
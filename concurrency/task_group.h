@@ -0,0 +1,324 @@
+/**
+ * task_group.h
+ */
+#ifndef CONCURRENCY_TASK_GROUP_H_
+#define CONCURRENCY_TASK_GROUP_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "executor.h"
+#include "../util/util.h"
+
+namespace conc11 {
+
+namespace detail {
+
+/**
+ * Shared state of a TaskGroup and its tasks. All counting goes through one atomic word holding
+ * the cancelled flag, the number of running tasks and the number of queued tasks, so that
+ * cancelling can atomically forget the queued tasks while running ones finish.
+ */
+class TaskGroupState {
+public:
+    TaskGroupState() noexcept:word(0) {
+    }
+
+    /**
+     * Count a task about to be queued. Returns false if the group is cancelled.
+     */
+    bool add() noexcept {
+        uint64_t w = word.load();
+        do {
+            if (w & CANCELLED) {
+                return false;
+            }
+        } while (!word.compare_exchange_weak(w, w + 1));
+        return true;
+    }
+
+    /**
+     * Move a queued task to running. Returns false if the group is cancelled, in which case the
+     * task was already forgotten and must not run.
+     */
+    bool start() noexcept {
+        uint64_t w = word.load();
+        do {
+            if (w & CANCELLED) {
+                return false;
+            }
+        } while (!word.compare_exchange_weak(w, w - 1 + RUNNING_ONE));
+        return true;
+    }
+
+    void finish() {
+        uint64_t w = word.fetch_sub(RUNNING_ONE) - RUNNING_ONE;
+        if ((w & ~CANCELLED) == 0) {
+            notify_done();
+        }
+    }
+
+    /**
+     * Forget a queued task destroyed without running, such as one dropped by the executor.
+     */
+    void abandon() {
+        uint64_t w = word.load();
+        do {
+            if (w & CANCELLED) {
+                return;
+            }
+        } while (!word.compare_exchange_weak(w, w - 1));
+        if (((w - 1) & ~CANCELLED) == 0) {
+            notify_done();
+        }
+    }
+
+    void cancel() {
+        uint64_t w = word.load();
+        do {
+            if (w & CANCELLED) {
+                return;
+            }
+        } while (!word.compare_exchange_weak(w, (w & RUNNING_MASK) | CANCELLED));
+        if ((w & RUNNING_MASK) == 0) {
+            notify_done();
+        }
+    }
+
+    /**
+     * Record the first exception thrown by a task and cancel the group.
+     */
+    void fail(std::exception_ptr e) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!error) {
+                error = e;
+            }
+        }
+        cancel();
+    }
+
+    bool is_cancelled() const noexcept {
+        return (word.load(std::memory_order_acquire) & CANCELLED) != 0;
+    }
+
+    bool is_done() const noexcept {
+        return (word.load() & ~CANCELLED) == 0;
+    }
+
+    size_t get_queued_count() const noexcept {
+        return static_cast<size_t>(word.load(std::memory_order_relaxed) & QUEUED_MASK);
+    }
+
+    size_t get_running_count() const noexcept {
+        return static_cast<size_t>((word.load(std::memory_order_relaxed) & RUNNING_MASK) >> 32);
+    }
+
+    template<class Clock, class Duration>
+    bool wait_until(const std::chrono::time_point<Clock, Duration>& timeout_time) {
+        if (is_done()) {
+            return true;
+        }
+        std::unique_lock<std::mutex> lock(mtx);
+        return cv.wait_until(lock, timeout_time, [this]() {return is_done();});
+    }
+
+    void rethrow_error() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    static const uint64_t CANCELLED = 1ULL << 63;
+    static const uint64_t RUNNING_ONE = 1ULL << 32;
+    static const uint64_t RUNNING_MASK = ((1ULL << 31) - 1) << 32;
+    static const uint64_t QUEUED_MASK = (1ULL << 32) - 1;
+
+    void notify_done() {
+        std::unique_lock<std::mutex> lock(mtx);
+        lock.unlock(); // Sync with a waiter that already checked is_done but is not yet waiting
+        cv.notify_all();
+    }
+
+    std::atomic<uint64_t> word;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::exception_ptr error;
+};
+
+/**
+ * A task of a TaskGroup. Skips its callable if the group was cancelled meanwhile, and forgets
+ * itself in the group if destroyed without running. Move only, so that exactly one instance
+ * owns the group reference.
+ */
+template<class Runnable>
+class GroupTask {
+public:
+    GroupTask(std::shared_ptr<TaskGroupState> state, Runnable&& r) :
+            state(std::move(state)), r(std::forward<Runnable>(r)) {
+    }
+
+    GroupTask(GroupTask&&) = default;
+    GroupTask(const GroupTask&) = delete;
+    GroupTask& operator=(const GroupTask&) = delete;
+
+    ~GroupTask() {
+        if (state) {
+            state->abandon();
+        }
+    }
+
+    void operator()() {
+        std::shared_ptr<TaskGroupState> s(std::move(state));
+        if (!s->start()) {
+            return;
+        }
+        try {
+            r();
+        } catch (...) {
+            s->fail(std::current_exception());
+        }
+        s->finish();
+    }
+
+private:
+    std::shared_ptr<TaskGroupState> state;
+    typename std::remove_reference<Runnable>::type r;
+};
+
+} // namespace detail
+
+/**
+ * Handle for polling whether a TaskGroup was cancelled. Cheap to copy and valid after the group
+ * is destroyed.
+ */
+class CancellationToken {
+public:
+    CancellationToken() noexcept = default;
+
+    bool is_cancelled() const noexcept {
+        return state && state->is_cancelled();
+    }
+
+    explicit operator bool() const noexcept {
+        return is_cancelled();
+    }
+
+private:
+    friend class TaskGroup;
+
+    explicit CancellationToken(std::shared_ptr<detail::TaskGroupState> s) noexcept:
+    state(std::move(s)) {
+    }
+
+    std::shared_ptr<detail::TaskGroupState> state;
+};
+
+/**
+ * A set of related tasks run on a ThreadPoolExecutor that can be waited for and cancelled
+ * together. A single counter tracks the queued and running tasks of the group.
+ *
+ * Cancelling forgets the queued tasks at once. They are skipped without running when the
+ * executor reaches them, and tasks run() after cancelling are dropped. Running tasks are not
+ * interrupted, but may poll get_token() and return early. The first exception thrown by a task
+ * cancels the group and is rethrown by wait().
+ * Tasks keep the state of the group alive, so the group may be destroyed before they finish.
+ */
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPoolExecutor& executor) :
+            executor(executor), state(std::make_shared<detail::TaskGroupState>()) {
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    /**
+     * Run a callable and its parameters in the group, like ThreadPoolExecutor::execute().
+     * Returns false if the group is cancelled and the callable was dropped. Throws like
+     * execute() if the executor rejects the task.
+     */
+    template<typename Callable, typename ... Args>
+    bool run(Callable&& c, Args&&... args) {
+        auto bind_obj = std::bind(std::forward<Callable>(c), std::forward<Args>(args)...);
+        if (!state->add()) {
+            return false;
+        }
+        // If the executor rejects or drops the task, its destructor forgets it in the group
+        executor.execute(detail::GroupTask<decltype(bind_obj)>(state, std::move(bind_obj)));
+        return true;
+    }
+
+    /**
+     * Wait until no task of the group is queued or running, then rethrow the first exception
+     * thrown by a task, if any. Called from a worker of the executor, the worker runs queued
+     * tasks meanwhile, see ThreadPoolExecutor::join().
+     */
+    void wait() {
+        executor.help_until([this]() {
+            return state->is_done();
+        }, [this](std::chrono::microseconds timeout) {
+            state->wait_until(std::chrono::steady_clock::now() + timeout);
+        });
+        state->rethrow_error();
+    }
+
+    /**
+     * Wait like wait() for at most timeout_duration, without running other tasks. Returns false
+     * on timeout.
+     */
+    template<class Rep, class Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout_duration) {
+        return wait_until(std::chrono::steady_clock::now() + timeout_duration);
+    }
+
+    template<class Clock, class Duration>
+    bool wait_until(const std::chrono::time_point<Clock, Duration>& timeout_time) {
+        if (!state->wait_until(timeout_time)) {
+            return false;
+        }
+        state->rethrow_error();
+        return true;
+    }
+
+    void cancel() {
+        state->cancel();
+    }
+
+    bool is_cancelled() const noexcept {
+        return state->is_cancelled();
+    }
+
+    /**
+     * Token for running tasks to poll for cancellation.
+     */
+    CancellationToken get_token() const {
+        return CancellationToken(state);
+    }
+
+    /**
+     * Return number of tasks queued and not yet started, 0 once cancelled.
+     */
+    size_t get_queued_count() const noexcept {
+        return state->get_queued_count();
+    }
+
+    size_t get_running_count() const noexcept {
+        return state->get_running_count();
+    }
+
+private:
+    ThreadPoolExecutor& executor;
+    std::shared_ptr<detail::TaskGroupState> state;
+};
+
+} // namespace conc11
+
+#endif /* CONCURRENCY_TASK_GROUP_H_ */
@@ -0,0 +1,392 @@
+/**
+ * task_queue.h
+ */
+#ifndef CONCURRENCY_TASK_QUEUE_H_
+#define CONCURRENCY_TASK_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "../util/util.h"
+
+namespace conc11 {
+
+/**
+ * Order in which a ThreadPoolExecutor takes tasks from its shared queue.
+ */
+enum class QueueDiscipline {
+    // First in, first out.
+    FIFO,
+    // A few discrete priority lanes, FIFO within a lane. Waiting tasks age into higher lanes.
+    PRIORITY_LANES,
+    // The task with the earliest deadline first, FIFO among equal deadlines.
+    EARLIEST_DEADLINE_FIRST
+};
+
+/**
+ * Run time of the tasks of one tenant, recorded by workers without locking and shared by the
+ * queues of all placement domains.
+ */
+struct TenantUsage {
+    TenantUsage() noexcept:run_nanoseconds(0), completed(0) {
+    }
+
+    void record(uint64_t nanoseconds) noexcept {
+        run_nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+        completed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Mean run time of the completed tasks, 0 if none completed.
+     */
+    uint64_t mean_run_time() const noexcept {
+        uint64_t n = completed.load(std::memory_order_relaxed);
+        return n > 0 ? run_nanoseconds.load(std::memory_order_relaxed) / n : 0;
+    }
+
+    std::atomic<uint64_t> run_nanoseconds;
+    std::atomic<uint64_t> completed;
+};
+
+/**
+ * The shared task queue of a ThreadPoolExecutor. Not thread safe, guarded by the executor lock.
+ *
+ * In PRIORITY_LANES mode priorities range from 0, the default and lowest, to levels - 1, and out
+ * of range priorities are clamped. A task counts as one level more urgent for every aging_interval
+ * it has waited, so a steady stream of high priority tasks delays low priority ones but never
+ * starves them. A zero aging_interval disables aging.
+ * In EARLIEST_DEADLINE_FIRST mode tasks pushed without a deadline are due default_deadline after
+ * being pushed. As deadlines are absolute, every task eventually becomes the most urgent one.
+ *
+ * Tasks belong to tenants, each with a queue of its own ordered by the discipline. Tenant 0
+ * exists from construction. With several tenants, pop() takes from the tenant with the least
+ * virtual run time, which grows by the estimated run time of every task taken divided by the
+ * weight of the tenant, so that busy tenants share workers in proportion to their weights. The
+ * estimate is the mean run time in the TenantUsage of the tenant, or one microsecond until known.
+ * A tenant that becomes busy again resumes at the virtual time of the others, rather than
+ * catching up on the share it did not use.
+ */
+class TaskQueue {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TaskQueue(QueueDiscipline discipline = QueueDiscipline::FIFO, size_t levels = 1,
+                       Clock::duration aging_interval = Clock::duration::zero(),
+                       Clock::duration default_deadline = Clock::duration::zero(),
+                       const TenantUsage* default_usage = nullptr) :
+            discipline(discipline), aging_interval(aging_interval),
+                    default_deadline(default_deadline),
+                    levels(discipline != QueueDiscipline::PRIORITY_LANES ? 0 :
+                            levels > 0 ? levels : 1) {
+        add_tenant(1, default_usage);
+    }
+
+    TaskQueue(const TaskQueue&) = delete;
+    TaskQueue& operator=(const TaskQueue&) = delete;
+
+    /**
+     * Add a tenant with a weight of at least 1. Returns its index.
+     */
+    size_t add_tenant(unsigned weight, const TenantUsage* usage) {
+        tenants.emplace_back(new Tenant(levels, weight > 0 ? weight : 1, usage));
+        return tenants.size() - 1;
+    }
+
+    void push(UniqueTask&& task, size_t tenant = 0) {
+        switch (discipline) {
+        case QueueDiscipline::FIFO: {
+            Tenant& t = activate(tenant);
+            t.fifo.push(std::move(task));
+            ++t.count;
+            ++count;
+            break;
+        }
+        case QueueDiscipline::PRIORITY_LANES:
+            push_with_priority(std::move(task), 0, tenant);
+            break;
+        case QueueDiscipline::EARLIEST_DEADLINE_FIRST:
+            push_with_deadline(std::move(task), Clock::now() + default_deadline, tenant);
+            break;
+        }
+    }
+
+    /**
+     * Push with a priority. The priority is ignored unless in PRIORITY_LANES mode.
+     */
+    void push_with_priority(UniqueTask&& task, int priority, size_t tenant = 0) {
+        if (discipline != QueueDiscipline::PRIORITY_LANES) {
+            push(std::move(task), tenant);
+            return;
+        }
+        size_t lane = priority < 0 ? 0 : static_cast<size_t>(priority);
+        if (lane >= levels) {
+            lane = levels - 1;
+        }
+        Clock::time_point now = aging_interval.count() > 0 ? Clock::now() : Clock::time_point();
+        Tenant& t = activate(tenant);
+        t.lanes[lane].emplace(std::move(task), now, 0);
+        ++t.count;
+        ++count;
+    }
+
+    /**
+     * Push with a deadline. The deadline is ignored unless in EARLIEST_DEADLINE_FIRST mode.
+     */
+    void push_with_deadline(UniqueTask&& task, Clock::time_point deadline, size_t tenant = 0) {
+        if (discipline != QueueDiscipline::EARLIEST_DEADLINE_FIRST) {
+            push(std::move(task), tenant);
+            return;
+        }
+        Tenant& t = activate(tenant);
+        t.heap.emplace_back(std::move(task), deadline, next_seq++);
+        std::push_heap(t.heap.begin(), t.heap.end(), LaterDeadline());
+        ++t.count;
+        ++count;
+    }
+
+    /**
+     * Remove and return the next task. The queue must not be empty. The index of the tenant of
+     * the task is stored to tenant if not null.
+     */
+    UniqueTask pop(size_t* tenant = nullptr) {
+        assert(count > 0);
+        size_t index = tenants.size() > 1 ? next_tenant() : 0;
+        if (tenant) {
+            *tenant = index;
+        }
+        Tenant& t = *tenants[index];
+        UniqueTask task;
+        switch (discipline) {
+        case QueueDiscipline::FIFO:
+            task = std::move(t.fifo.front());
+            t.fifo.pop();
+            break;
+        case QueueDiscipline::PRIORITY_LANES: {
+            RingQueue<Entry>& lane = t.lanes[select_lane(t, true)];
+            task = std::move(lane.front().task);
+            lane.pop();
+            break;
+        }
+        case QueueDiscipline::EARLIEST_DEADLINE_FIRST:
+            std::pop_heap(t.heap.begin(), t.heap.end(), LaterDeadline());
+            task = std::move(t.heap.back().task);
+            t.heap.pop_back();
+            break;
+        }
+        --t.count;
+        ++t.dispatched;
+        --count;
+        return task;
+    }
+
+    /**
+     * Remove and return a task to drop rather than run: the oldest of the least urgent ones,
+     * which is the oldest task in FIFO mode, the oldest of the least urgent lane after aging in
+     * PRIORITY_LANES mode, and the first pushed of those with the latest deadline in
+     * EARLIEST_DEADLINE_FIRST mode. With several tenants it is taken from the one with the most
+     * queued tasks. Virtual times are left alone and the task does not count as dispatched. The
+     * queue must not be empty.
+     */
+    UniqueTask pop_least_urgent() {
+        assert(count > 0);
+        size_t index = 0;
+        for (size_t i = 1; i < tenants.size(); ++i) {
+            if (tenants[i]->count > tenants[index]->count) {
+                index = i;
+            }
+        }
+        Tenant& t = *tenants[index];
+        UniqueTask task;
+        switch (discipline) {
+        case QueueDiscipline::FIFO:
+            task = std::move(t.fifo.front());
+            t.fifo.pop();
+            break;
+        case QueueDiscipline::PRIORITY_LANES: {
+            RingQueue<Entry>& lane = t.lanes[select_lane(t, false)];
+            task = std::move(lane.front().task);
+            lane.pop();
+            break;
+        }
+        case QueueDiscipline::EARLIEST_DEADLINE_FIRST: {
+            size_t victim = 0;
+            for (size_t i = 1; i < t.heap.size(); ++i) {
+                const Entry& e = t.heap[i];
+                const Entry& v = t.heap[victim];
+                if (e.time > v.time || (e.time == v.time && e.seq < v.seq)) {
+                    victim = i;
+                }
+            }
+            task = std::move(t.heap[victim].task);
+            if (victim + 1 < t.heap.size()) {
+                t.heap[victim] = std::move(t.heap.back());
+                t.heap.pop_back();
+                std::make_heap(t.heap.begin(), t.heap.end(), LaterDeadline());
+            } else {
+                t.heap.pop_back();
+            }
+            break;
+        }
+        }
+        --t.count;
+        --count;
+        return task;
+    }
+
+    /**
+     * The next task in FIFO mode with a single tenant, which stays in the queue until pop().
+     * The queue must not be empty.
+     */
+    UniqueTask& front() {
+        assert(discipline == QueueDiscipline::FIFO && tenants.size() == 1);
+        return tenants[0]->fifo.front();
+    }
+
+    bool empty() const noexcept {
+        return count == 0;
+    }
+
+    size_t size() const noexcept {
+        return count;
+    }
+
+    QueueDiscipline get_discipline() const noexcept {
+        return discipline;
+    }
+
+    size_t get_tenant_count() const noexcept {
+        return tenants.size();
+    }
+
+    /**
+     * Number of queued tasks of a tenant.
+     */
+    size_t get_tenant_size(size_t tenant) const noexcept {
+        return tenants[tenant]->count;
+    }
+
+    /**
+     * Number of tasks of a tenant taken by pop().
+     */
+    uint64_t get_tenant_dispatched(size_t tenant) const noexcept {
+        return tenants[tenant]->dispatched;
+    }
+
+private:
+    struct Entry {
+        Entry(UniqueTask&& task, Clock::time_point time, uint64_t seq) noexcept:
+        task(std::move(task)), time(time), seq(seq) {
+        }
+
+        UniqueTask task;
+        // Enqueue time in PRIORITY_LANES mode, deadline in EARLIEST_DEADLINE_FIRST mode
+        Clock::time_point time;
+        uint64_t seq;
+    };
+
+    struct LaterDeadline {
+        bool operator()(const Entry& a, const Entry& b) const noexcept {
+            return a.time != b.time ? a.time > b.time : a.seq > b.seq;
+        }
+    };
+
+    struct Tenant {
+        Tenant(size_t levels, unsigned weight, const TenantUsage* usage) :
+                lanes(levels), weight(weight), usage(usage) {
+        }
+
+        RingQueue<UniqueTask> fifo;
+        // PRIORITY_LANES mode, indexed by priority
+        std::vector<RingQueue<Entry>> lanes;
+        // EARLIEST_DEADLINE_FIRST mode, a min heap on deadline
+        std::vector<Entry> heap;
+        size_t count = 0;
+        uint64_t dispatched = 0;
+        const unsigned weight;
+        const TenantUsage* usage;
+        // Estimated run time of the tasks taken, divided by weight
+        uint64_t virtual_time = 0;
+    };
+
+    /**
+     * The tenant a task is about to be pushed to, moved up to the current virtual time if it
+     * was idle.
+     */
+    Tenant& activate(size_t tenant) {
+        assert(tenant < tenants.size());
+        Tenant& t = *tenants[tenant];
+        if (t.count == 0 && t.virtual_time < virtual_now) {
+            t.virtual_time = virtual_now;
+        }
+        return t;
+    }
+
+    /**
+     * The non-empty tenant with the least virtual time, charged with its estimated task run
+     * time. Ties go to the lower index.
+     */
+    size_t next_tenant() {
+        size_t best = tenants.size();
+        for (size_t i = 0; i < tenants.size(); ++i) {
+            if (tenants[i]->count > 0 && (best == tenants.size() ||
+                    tenants[i]->virtual_time < tenants[best]->virtual_time)) {
+                best = i;
+            }
+        }
+        Tenant& t = *tenants[best];
+        virtual_now = std::max(virtual_now, t.virtual_time);
+        uint64_t cost = t.usage ? t.usage->mean_run_time() : 0;
+        t.virtual_time += (cost > 0 ? cost : 1000) / t.weight + 1;
+        return best;
+    }
+
+    /**
+     * The non-empty lane whose head has the highest priority after aging if most_urgent, else
+     * the lowest. Ties go to the higher lane if most_urgent, else to the lower one.
+     */
+    size_t select_lane(Tenant& t, bool most_urgent) {
+        assert(t.count > 0);
+        size_t best = levels;
+        uint64_t best_priority = 0;
+        Clock::time_point now;
+        for (size_t lane = levels; lane-- > 0;) {
+            if (t.lanes[lane].empty()) {
+                continue;
+            }
+            uint64_t priority = lane;
+            if (aging_interval.count() > 0) {
+                if (now == Clock::time_point()) {
+                    now = Clock::now();
+                }
+                priority += static_cast<uint64_t>((now - t.lanes[lane].front().time) /
+                        aging_interval);
+            }
+            if (best == levels || (most_urgent ? priority > best_priority :
+                    priority <= best_priority)) {
+                best = lane;
+                best_priority = priority;
+            }
+        }
+        return best;
+    }
+
+    const QueueDiscipline discipline;
+    const Clock::duration aging_interval;
+    const Clock::duration default_deadline;
+    // Number of priority lanes of every tenant in PRIORITY_LANES mode, 0 otherwise
+    const size_t levels;
+
+    std::vector<std::unique_ptr<Tenant>> tenants;
+    // Virtual time of the tenant last taken from
+    uint64_t virtual_now = 0;
+    uint64_t next_seq = 0;
+    size_t count = 0;
+};
+
+} // namespace conc11
+
+#endif /* CONCURRENCY_TASK_QUEUE_H_ */
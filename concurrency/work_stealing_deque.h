@@ -0,0 +1,177 @@
+/**
+ * work_stealing_deque.h
+ */
+#ifndef CONCURRENCY_WORK_STEALING_DEQUE_H_
+#define CONCURRENCY_WORK_STEALING_DEQUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "../util/bits/cache_line.h"
+
+namespace conc11 {
+
+/**
+ * A bounded work-stealing deque in the style of Chase and Lev. The owner thread pushes and pops
+ * elements at the bottom end without locking, while any number of thief threads steal elements
+ * from the top end.
+ * Unlike the original algorithm the buffer never grows: push() fails when the deque is full and
+ * the caller is expected to put the element somewhere else. Elements are stored inline and every
+ * slot carries a sequence number, so the owner never reuses a slot that a thief is still moving
+ * an element out of.
+ */
+template<class T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(std::size_t min_capacity) :
+            cap(round_up_capacity(min_capacity)), mask(cap - 1),
+                    slots(new Slot[cap]), top(0), bottom(0) {
+        for (std::size_t i = 0; i < cap; ++i) {
+            slots[i].seq.store(static_cast<int64_t>(i), std::memory_order_relaxed);
+        }
+    }
+
+    ~WorkStealingDeque() {
+        // Destructor shall not race with owner or thieves.
+        int64_t t = top.load(std::memory_order_relaxed);
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        for (; t < b; ++t) {
+            slot_at(t).get()->~T();
+        }
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    /**
+     * Push an element at the bottom. Owner thread only.
+     * Returns false and leaves value untouched if the deque is full.
+     */
+    bool push(T&& value) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        Slot& slot = slot_at(b);
+        if (slot.seq.load(std::memory_order_acquire) != b) {
+            return false; // full, or a thief has not finished moving out of this slot yet
+        }
+        new (&slot.storage) T(std::move(value));
+        bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Pop the most recently pushed element from the bottom. Owner thread only.
+     */
+    bool pop(T* out) {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_seq_cst);
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_release);
+            return false;
+        }
+        Slot& slot = slot_at(b);
+        if (t == b) {
+            // Last element, race against thieves for it
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                    std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_release);
+            if (!won) {
+                return false;
+            }
+            move_out(slot, out);
+            // top has moved past b, so this slot will next be used by index b + cap
+            slot.seq.store(b + static_cast<int64_t>(cap), std::memory_order_release);
+            return true;
+        }
+        // No thief can reach index b, and the next push reuses it with the same sequence.
+        move_out(slot, out);
+        return true;
+    }
+
+    /**
+     * Steal the least recently pushed element from the top. May be called from any thread.
+     * Returns false if the deque is empty or the steal lost a race with another thread.
+     */
+    bool steal(T* out) {
+        int64_t t = top.load(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_seq_cst);
+        if (t >= b) {
+            return false;
+        }
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                std::memory_order_relaxed)) {
+            return false;
+        }
+        Slot& slot = slot_at(t);
+        move_out(slot, out);
+        slot.seq.store(t + static_cast<int64_t>(cap), std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Returns true if the deque is observed empty. Approximate when called concurrently.
+     */
+    bool empty() const noexcept {
+        return top.load(std::memory_order_seq_cst) >= bottom.load(std::memory_order_seq_cst);
+    }
+
+    /**
+     * Returns number of elements in the deque. Approximate when called concurrently.
+     */
+    std::size_t size() const noexcept {
+        int64_t b = bottom.load(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_seq_cst);
+        return b > t ? static_cast<std::size_t>(b - t) : 0;
+    }
+
+    std::size_t capacity() const noexcept {
+        return cap;
+    }
+
+private:
+    struct Slot {
+        std::atomic<int64_t> seq;
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+
+        T* get() noexcept {
+            return reinterpret_cast<T*>(&storage);
+        }
+    };
+
+    static std::size_t round_up_capacity(std::size_t min_capacity) noexcept {
+        std::size_t c = 2;
+        while (c < min_capacity) {
+            c <<= 1;
+        }
+        return c;
+    }
+
+    Slot& slot_at(int64_t index) noexcept {
+        return slots[static_cast<std::size_t>(index) & mask];
+    }
+
+    static void move_out(Slot& slot, T* out) {
+        T* p = slot.get();
+        *out = std::move(*p);
+        p->~T();
+    }
+
+    const std::size_t cap;
+    const std::size_t mask;
+    std::unique_ptr<Slot[]> slots;
+
+    // top is written by thieves and bottom by the owner, keep them on separate cache lines.
+    char pad0[CACHE_LINE_SIZE];
+    std::atomic<int64_t> top;
+    char pad1[CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> bottom;
+    char pad2[CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+};
+
+} // namespace conc11
+
+#endif /* CONCURRENCY_WORK_STEALING_DEQUE_H_ */
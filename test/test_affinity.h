@@ -0,0 +1,127 @@
+/**
+ * test_affinity.h
+ */
+#ifndef TEST_TEST_AFFINITY_H_
+#define TEST_TEST_AFFINITY_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../concurrency/affinity.h"
+#include "../concurrency/executor.h"
+#include "../concurrency/latch.h"
+
+namespace conc11 {
+
+namespace test {
+
+/**
+ * Number of CPUs the calling thread may run on, or 0 if unknown.
+ */
+int current_thread_cpu_count() {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+        return CPU_COUNT(&set);
+    }
+#endif
+    return 0;
+}
+
+void test_cpu_topology() {
+    assert((parse_cpu_list("0-3,8,10-11") == std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    assert(parse_cpu_list("").empty());
+    assert((parse_cpu_list("x,5,3-1,7-") == std::vector<int>{5}));
+
+    CpuTopology topology = CpuTopology::detect();
+    assert(topology.node_count() >= 1);
+    std::vector<int> cpus = topology.all_cpus();
+    assert(!cpus.empty());
+    for (const auto& node : topology.get_nodes()) {
+        assert(!node.empty());
+    }
+
+#if defined(__linux__)
+    // Pin a scratch thread so that the affinity of the test thread is left alone
+    std::thread([&cpus]() {
+        assert(set_current_thread_affinity(std::vector<int>{cpus[0]}));
+        assert(current_thread_cpu_count() == 1);
+        assert(set_current_thread_affinity(cpus));
+        assert(!set_current_thread_affinity(std::vector<int>{-1}));
+    }).join();
+#endif
+    printf("CPU topology done\n");
+}
+
+void test_executor_placement() {
+    // Two domains sharing one CPU, which every machine has
+    int cpu = CpuTopology::detect().all_cpus()[0];
+    ThreadPoolOptions options;
+    options.placement_domains = {{cpu}, {cpu}};
+    options.pin_to_core = true;
+    {
+        auto exec = make_fixed_thread_pool(4, options);
+        assert(exec->get_domain_count() == 2);
+        std::vector<std::future<int>> futures;
+        for (size_t i = 0; i < 16; ++i) {
+            futures.push_back(exec->submit_on(i, current_thread_cpu_count));
+        }
+        for (auto& f : futures) {
+            int count = f.get();
+            assert(count == 0 || count == 1);
+        }
+    }
+
+    // A worker drains its own domain before taking tasks of other domains
+    for (auto mode : {SchedulingMode::SHARED_QUEUE, SchedulingMode::WORK_STEALING}) {
+        options.scheduling_mode = mode;
+        Latch started(1);
+        std::promise<void> gate;
+        std::shared_future<void> gate_future = gate.get_future().share();
+        std::mutex order_lock;
+        std::string order;
+        auto record = [&order_lock, &order](char c) {
+            std::lock_guard<std::mutex> lock(order_lock);
+            order += c;
+        };
+        {
+            ThreadPoolExecutor exec(1, 1, 0L, options);
+            exec.execute([&started, gate_future]() {
+                started.count_down(1);
+                gate_future.wait();
+            });
+            started.wait();
+            exec.execute_on(1, record, 'b');
+            exec.execute_on(1, record, 'b');
+            exec.execute_on(0, record, 'a');
+            exec.execute_on(2, record, 'a');
+            assert(exec.get_queue_size() == 4);
+            gate.set_value();
+            exec.shutdown();
+            exec.await_termination();
+        }
+        assert(order == "aabb");
+    }
+
+    auto numa = make_numa_thread_pool(1);
+    assert(numa->get_pool_size() == CpuTopology::detect().node_count());
+    assert(numa->submit_on(numa->get_domain_count() - 1, []() {return 42;}).get() == 42);
+    printf("Executor placement done\n");
+}
+
+void test_affinity() {
+    test_cpu_topology();
+    test_executor_placement();
+}
+
+} // namespace test
+
+} // namespace conc11
+
+#endif /* TEST_TEST_AFFINITY_H_ */
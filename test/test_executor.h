@@ -5,9 +5,18 @@
 #ifndef TEST_TEST_EXECUTOR_H_
 #define TEST_TEST_EXECUTOR_H_
 
+#include <algorithm>
 #include <atomic>
+#include <cassert>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 #include "../concurrency/executor.h"
+#include "../concurrency/latch.h"
 
 namespace conc11 {
 
@@ -126,6 +135,675 @@ void test_executor_atomic() {
     printf("Final value of atomic counter: %d\n", ac.get());
 }
 
+static void spawn_tree(ThreadPoolExecutor* exec, int depth, AtomicCounter* ac, Latch* latch) {
+    if (depth == 0) {
+        ac->add(1);
+        latch->count_down(1);
+        return;
+    }
+    if (depth % 2 == 0) {
+        exec->execute(spawn_tree, exec, depth - 1, ac, latch);
+        exec->execute(spawn_tree, exec, depth - 1, ac, latch);
+    } else {
+        exec->execute_n(2, [=](size_t) {spawn_tree(exec, depth - 1, ac, latch);});
+    }
+}
+
+void test_executor_work_stealing() {
+    static const int DEPTH = 16;
+    AtomicCounter ac;
+    Latch latch(1 << DEPTH);
+    auto exec = make_work_stealing_pool(4);
+    exec->execute(spawn_tree, exec.get(), DEPTH, &ac, &latch);
+    latch.wait();
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < 100000; ++i) {
+        futures.emplace_back(exec->submit(&AtomicCounter::add, &ac, 1));
+    }
+    for (auto &future : futures) {
+        future.get();
+    }
+    exec->shutdown();
+    exec->await_termination();
+    assert(ac.get() == (1 << DEPTH) + 100000);
+    printf("Final value of work stealing counter: %d\n", ac.get());
+}
+
+struct LargeFunctor {
+    void operator()() {
+        ac->add(static_cast<int>(payload[0] + payload[15]));
+    }
+    AtomicCounter* ac;
+    long payload[16];
+};
+
+void test_executor_task_storage() {
+    AtomicCounter ac;
+    LargeFunctor large;
+    large.ac = &ac;
+    for (int i = 0; i < 16; ++i) {
+        large.payload[i] = 0;
+    }
+    large.payload[15] = 1;
+    assert(UniqueTask([&ac]() {ac.add(1);}).is_inline());
+    assert(!UniqueTask(large).is_inline());
+
+    auto exec = make_fixed_thread_pool(4);
+    for (int i = 0; i < 100000; ++i) {
+        exec->execute(&AtomicCounter::add, &ac, 1);
+        exec->execute(large);
+    }
+    exec->shutdown();
+    exec->await_termination();
+    assert(ac.get() == 200000);
+    printf("Final value of task storage counter: %d\n", ac.get());
+}
+
+void test_executor_bulk() {
+    AtomicCounter ac;
+    auto exec = make_fixed_thread_pool(4);
+    std::vector<std::function<void()>> callables;
+    for (int i = 0; i < 10000; ++i) {
+        callables.emplace_back(std::bind(&AtomicCounter::add, &ac, 1));
+    }
+    exec->execute_bulk(callables);
+    exec->execute_bulk(callables.begin(), callables.begin() + 5000);
+    exec->execute_n(10000, [&ac](size_t i) {ac.add(static_cast<int>(i % 2));});
+
+    std::vector<std::function<int()>> int_callables;
+    for (int i = 0; i < 10000; ++i) {
+        int_callables.emplace_back(std::bind(dummy_func, i, 0));
+    }
+    std::vector<std::future<int>> futures = exec->submit_bulk(int_callables);
+    for (int i = 0; i < 10000; ++i) {
+        assert(futures[i].get() == 233 + i);
+    }
+    exec->shutdown();
+    exec->await_termination();
+    assert(ac.get() == 20000);
+
+    // A bulk submission grows a cached pool no more than submitting its tasks one by one
+    auto cached = make_cached_thread_pool();
+    cached->execute_n(10000, [&ac](size_t) {ac.add(1);});
+    assert(cached->get_pool_size() == 1);
+    cached->execute_bulk(callables);
+    assert(cached->get_pool_size() <= 2);
+    cached->shutdown();
+    cached->await_termination();
+    assert(ac.get() == 40000);
+    printf("Final value of bulk counter: %d\n", ac.get());
+}
+
+/**
+ * Runs submit_all on a single thread pool while its only worker is blocked, then returns the
+ * order in which the submitted tasks ran.
+ */
+template<class SubmitAll>
+static std::vector<int> run_order(const ThreadPoolOptions& options, SubmitAll submit_all) {
+    ThreadPoolExecutor exec(1, 1, 0L, options);
+    Latch started(1);
+    Latch gate(1);
+    exec.execute([&]() {started.count_down(1); gate.wait();});
+    started.wait();
+    std::mutex order_lock;
+    std::vector<int> order;
+    submit_all(exec, [&](int i) {
+        std::lock_guard<std::mutex> lock(order_lock);
+        order.push_back(i);
+    });
+    gate.count_down(1);
+    exec.shutdown();
+    exec.await_termination();
+    return order;
+}
+
+void test_executor_priority() {
+    ThreadPoolOptions options;
+    options.queue_discipline = QueueDiscipline::PRIORITY_LANES;
+    options.priority_levels = 3;
+    std::vector<int> order = run_order(options, [](ThreadPoolExecutor& exec,
+            std::function<void(int)> record) {
+        exec.submit(record, 0);
+        exec.submit_with_priority(0, record, 1);
+        exec.submit_with_priority(2, record, 2);
+        exec.submit_with_priority(1, record, 3);
+        exec.submit_with_priority(7, record, 4); // clamped to 2
+        exec.submit_with_priority(2, record, 5);
+    });
+    assert((order == std::vector<int>{2, 4, 5, 3, 0, 1}));
+
+    // Low priority tasks age past fresh high priority ones
+    options.aging_interval = std::chrono::milliseconds(1);
+    order = run_order(options, [](ThreadPoolExecutor& exec, std::function<void(int)> record) {
+        exec.submit_with_priority(0, record, 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        exec.submit_with_priority(2, record, 1);
+    });
+    assert((order == std::vector<int>{0, 1}));
+
+    options.queue_discipline = QueueDiscipline::EARLIEST_DEADLINE_FIRST;
+    order = run_order(options, [](ThreadPoolExecutor& exec, std::function<void(int)> record) {
+        auto now = std::chrono::steady_clock::now();
+        exec.submit_with_deadline(now + std::chrono::seconds(3), record, 0);
+        exec.submit_with_deadline(now + std::chrono::seconds(2), record, 1);
+        exec.submit(record, 2); // due after default_deadline of one second
+        exec.submit_with_deadline(std::chrono::system_clock::now(), record, 3);
+        exec.submit_with_deadline(now + std::chrono::seconds(2), record, 4);
+    });
+    assert((order == std::vector<int>{3, 2, 1, 4, 0}));
+    printf("Priority and deadline ordering done\n");
+}
+
+void test_executor_fair_share() {
+    // A noisy tenant queues first, yet a heavier quiet tenant gets most of the single worker
+    std::vector<TenantMetrics> metrics;
+    std::vector<int> order = run_order(ThreadPoolOptions(), [&metrics](ThreadPoolExecutor& exec,
+            std::function<void(int)> record) {
+        size_t noisy = exec.add_tenant("noisy");
+        size_t quiet = exec.add_tenant("quiet", 3);
+        // Shares are of run time, so make it dominate measurement noise
+        auto busy = [record](int i) {
+            record(i);
+            auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(20);
+            while (std::chrono::steady_clock::now() < end) {
+            }
+        };
+        for (int i = 0; i < 300; ++i) {
+            exec.execute_as(noisy, busy, 1);
+        }
+        for (int i = 0; i < 100; ++i) {
+            exec.submit_as(quiet, busy, 2);
+        }
+        metrics = exec.get_tenant_metrics();
+    });
+    assert(order.size() == 400);
+    assert(std::count(order.begin(), order.begin() + 100, 2) >= 50);
+    assert(metrics.size() == 3 && metrics[0].name == "default" && metrics[2].weight == 3);
+    assert(metrics[1].queued == 300 && metrics[2].queued == 100 && metrics[1].dispatched == 0);
+
+    ThreadPoolExecutor exec(2, 2, 0L);
+    size_t tenant = exec.add_tenant("batch");
+    assert(exec.submit_as(tenant, []() {return 3;}).get() == 3);
+    bool thrown = false;
+    try {
+        exec.execute_as(5, []() {});
+    } catch (std::system_error& e) {
+        thrown = e.code() == std::make_error_code(std::errc::invalid_argument);
+    }
+    assert(thrown);
+    exec.shutdown();
+    exec.await_termination();
+    metrics = exec.get_tenant_metrics();
+    assert(metrics[1].dispatched == 1 && metrics[1].completed == 1 && metrics[1].queued == 0);
+    printf("Fair share across tenants done\n");
+}
+
+static bool rejected_with(ThreadPoolExecutor& exec, std::errc error) {
+    try {
+        exec.execute([]() {});
+    } catch (std::system_error& e) {
+        return e.code() == std::make_error_code(error);
+    }
+    return false;
+}
+
+static bool is_broken_promise(std::future<void>& f) {
+    try {
+        f.get();
+    } catch (std::future_error& e) {
+        return e.code() == std::future_errc::broken_promise;
+    }
+    return false;
+}
+
+void test_executor_bounded_queue() {
+    ThreadPoolOptions options;
+    options.max_queue_size = 2;
+    options.rejection_policy = RejectionPolicy::THROW;
+    {
+        Latch started(1);
+        Latch gate(1);
+        ThreadPoolExecutor exec(1, 1, 0L, options);
+        exec.execute([&]() {started.count_down(1); gate.wait();});
+        started.wait();
+        exec.execute([]() {});
+        exec.execute([]() {});
+        assert(rejected_with(exec, std::errc::resource_unavailable_try_again));
+        assert(exec.get_rejected_count() == 1 && exec.get_queue_size() == 2);
+        gate.count_down(1);
+    }
+
+    options.rejection_policy = RejectionPolicy::CALLER_RUNS;
+    {
+        Latch started(1);
+        Latch gate(1);
+        ThreadPoolExecutor exec(1, 1, 0L, options);
+        exec.execute([&]() {started.count_down(1); gate.wait();});
+        started.wait();
+        std::vector<std::future<std::thread::id>> futures;
+        for (int i = 0; i < 3; ++i) {
+            futures.emplace_back(exec.submit([]() {return std::this_thread::get_id();}));
+        }
+        assert(futures[2].get() == std::this_thread::get_id());
+        gate.count_down(1);
+        assert(futures[0].get() != std::this_thread::get_id());
+        assert(exec.get_rejected_count() == 1);
+    }
+
+    options.rejection_policy = RejectionPolicy::DISCARD_OLDEST;
+    std::vector<int> order = run_order(options, [](ThreadPoolExecutor& exec,
+            std::function<void(int)> record) {
+        std::future<void> oldest = exec.submit(record, 0);
+        exec.submit(record, 1);
+        exec.submit(record, 2);
+        assert(is_broken_promise(oldest) && exec.get_discarded_count() == 1);
+    });
+    assert((order == std::vector<int>{1, 2}));
+
+    // The least urgent task is dropped, not the next one to run
+    ThreadPoolOptions lanes = options;
+    lanes.queue_discipline = QueueDiscipline::PRIORITY_LANES;
+    lanes.priority_levels = 3;
+    order = run_order(lanes, [](ThreadPoolExecutor& exec, std::function<void(int)> record) {
+        exec.submit_with_priority(2, record, 0);
+        std::future<void> low = exec.submit_with_priority(0, record, 1);
+        exec.submit_with_priority(1, record, 2);
+        assert(is_broken_promise(low));
+    });
+    assert((order == std::vector<int>{0, 2}));
+
+    ThreadPoolOptions edf = options;
+    edf.queue_discipline = QueueDiscipline::EARLIEST_DEADLINE_FIRST;
+    order = run_order(edf, [](ThreadPoolExecutor& exec, std::function<void(int)> record) {
+        auto now = std::chrono::steady_clock::now();
+        exec.submit_with_deadline(now + std::chrono::seconds(1), record, 0);
+        std::future<void> late = exec.submit_with_deadline(now + std::chrono::hours(1), record, 1);
+        exec.submit_with_deadline(now + std::chrono::minutes(1), record, 2);
+        assert(is_broken_promise(late));
+    });
+    assert((order == std::vector<int>{0, 2}));
+
+    // With tenants the busiest one loses a task, without being charged for it
+    order = run_order(options, [](ThreadPoolExecutor& exec, std::function<void(int)> record) {
+        size_t batch = exec.add_tenant("batch");
+        std::future<void> dropped = exec.submit_as(batch, record, 0);
+        exec.submit_as(batch, record, 1);
+        exec.submit(record, 2);
+        assert(is_broken_promise(dropped));
+        std::vector<TenantMetrics> metrics = exec.get_tenant_metrics();
+        // The first task of tenant 0 is the one holding the worker
+        assert(metrics[0].dispatched == 1 && metrics[1].dispatched == 0);
+        assert(metrics[0].queued == 1 && metrics[1].queued == 1);
+    });
+    std::sort(order.begin(), order.end());
+    assert((order == std::vector<int>{1, 2}));
+
+    options.rejection_policy = RejectionPolicy::BLOCK;
+    options.block_timeout = std::chrono::milliseconds(10);
+    {
+        Latch started(1);
+        Latch gate(1);
+        ThreadPoolExecutor exec(1, 1, 0L, options);
+        exec.execute([&]() {started.count_down(1); gate.wait();});
+        started.wait();
+        exec.execute([]() {});
+        exec.execute([]() {});
+        assert(rejected_with(exec, std::errc::timed_out));
+        assert(exec.get_blocked_count() == 1 && exec.get_rejected_count() == 1);
+        gate.count_down(1);
+    }
+
+    // Blocked submitters, including bulk ones, resume as workers drain the queue
+    options.block_timeout = std::chrono::nanoseconds::max();
+    AtomicCounter ac;
+    {
+        ThreadPoolExecutor exec(4, 4, 0L, options);
+        std::vector<std::thread> submitters;
+        for (int t = 0; t < 4; ++t) {
+            submitters.emplace_back([&exec, &ac]() {
+                for (int i = 0; i < 1000; ++i) {
+                    exec.execute(&AtomicCounter::add, &ac, 1);
+                }
+                exec.execute_n(1000, [&ac](size_t) {ac.add(1);});
+            });
+        }
+        for (auto& th : submitters) {
+            th.join();
+        }
+        exec.shutdown();
+        exec.await_termination();
+        assert(exec.get_queue_size() == 0);
+    }
+    assert(ac.get() == 8000);
+    printf("Bounded queue done\n");
+}
+
+void test_executor_lock_free_queue() {
+    ThreadPoolOptions options;
+    options.lock_free_queue_capacity = 64;
+    for (int mode = 0; mode < 2; ++mode) {
+        options.scheduling_mode = mode == 0 ? SchedulingMode::SHARED_QUEUE :
+                SchedulingMode::WORK_STEALING;
+        std::atomic<int> ran(0);
+        {
+            ThreadPoolExecutor exec(4, 4, 0L, options);
+            std::vector<std::thread> submitters;
+            for (int t = 0; t < 3; ++t) {
+                submitters.emplace_back([&exec, &ran]() {
+                    for (int i = 0; i < 20000; ++i) {
+                        exec.execute([&ran]() {++ran;});
+                    }
+                    exec.execute_n(500, [&ran](size_t) {++ran;});
+                    assert(exec.submit([]() {return 1;}).get() == 1);
+                });
+            }
+            for (auto& th : submitters) {
+                th.join();
+            }
+            exec.shutdown();
+            exec.await_termination();
+        }
+        assert(ran.load() == 3 * 20500);
+    }
+
+    // Tasks overflowing the ring wait in the shared queue, and all run before termination
+    options.lock_free_queue_capacity = 2;
+    Latch started(1);
+    Latch gate(1);
+    std::atomic<int> ran(0);
+    ThreadPoolExecutor exec(1, 1, 0L, options);
+    exec.execute([&]() {started.count_down(1); gate.wait();});
+    started.wait();
+    for (int i = 0; i < 10; ++i) {
+        exec.execute([&ran]() {++ran;});
+    }
+    assert(exec.get_queue_size() == 10);
+    exec.shutdown();
+    gate.count_down(1);
+    exec.await_termination();
+    assert(ran.load() == 10);
+
+    // Tasks waiting in the ring count towards the peak queue depth
+    options.lock_free_queue_capacity = 64;
+    {
+        Latch ring_started(1);
+        Latch ring_gate(1);
+        ThreadPoolExecutor ring_exec(1, 1, 0L, options);
+        ring_exec.execute([&]() {ring_started.count_down(1); ring_gate.wait();});
+        ring_started.wait();
+        for (int i = 0; i < 20; ++i) {
+            ring_exec.execute([]() {});
+        }
+        assert(ring_exec.get_metrics().peak_queue_depth >= 20);
+        ring_gate.count_down(1);
+    }
+
+    // Every task accepted while shutdown() races the ring push runs before termination
+    for (int round = 0; round < 200; ++round) {
+        std::atomic<int> accepted(0);
+        std::atomic<int> done(0);
+        ThreadPoolExecutor racing(2, 2, 0L, options);
+        std::thread submitter([&racing, &accepted, &done]() {
+            try {
+                while (true) {
+                    racing.execute([&done]() {++done;});
+                    ++accepted;
+                }
+            } catch (std::system_error&) {
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::microseconds(round % 20 * 10));
+        racing.shutdown();
+        submitter.join();
+        bool terminated = racing.await_termination_for(std::chrono::seconds(10));
+        assert(terminated && done.load() == accepted.load());
+    }
+    printf("Lock-free queue done\n");
+}
+
+void test_executor_spinning() {
+    static const int DEPTH = 14;
+    ThreadPoolOptions options;
+    options.idle_spin_count = 2000;
+    options.idle_yield_count = 50;
+    for (SchedulingMode mode : {SchedulingMode::SHARED_QUEUE, SchedulingMode::WORK_STEALING}) {
+        options.scheduling_mode = mode;
+        ThreadPoolExecutor exec(4, 4, 0L, options);
+        AtomicCounter ac;
+        // Bursts of single tasks separated by pauses long enough for workers to park. Latches
+        // may still be counted down after wait() returns, keep them until the pool terminates.
+        std::vector<std::unique_ptr<Latch>> latches;
+        for (int burst = 0; burst < 20; ++burst) {
+            latches.emplace_back(new Latch(64));
+            Latch* latch = latches.back().get();
+            for (int i = 0; i < 64; ++i) {
+                exec.execute([&ac, latch]() {ac.add(1); latch->count_down(1);});
+            }
+            latch->wait();
+            if (burst % 4 == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }
+        Latch latch(1 << DEPTH);
+        exec.execute(spawn_tree, &exec, DEPTH, &ac, &latch);
+        latch.wait();
+        exec.execute_n(1000, [&ac](size_t) {ac.add(1);});
+        exec.shutdown();
+        exec.await_termination();
+        assert(ac.get() == 20 * 64 + (1 << DEPTH) + 1000);
+    }
+    printf("Spinning idle workers done\n");
+}
+
+void test_executor_metrics() {
+    ThreadPoolOptions options;
+    options.enable_metrics = true;
+    for (SchedulingMode mode : {SchedulingMode::SHARED_QUEUE, SchedulingMode::WORK_STEALING}) {
+        options.scheduling_mode = mode;
+        Latch started(1);
+        Latch gate(1);
+        AtomicCounter ac;
+        Latch tree_latch(1 << 10);
+        // Two core workers and up to two more that retire after 1ms idle
+        ThreadPoolExecutor exec(2, 4, 1000000L, options);
+        for (int i = 0; i < 4; ++i) {
+            exec.execute([&]() {started.count_down(1); gate.wait();});
+        }
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 100; ++i) {
+            futures.emplace_back(exec.submit([]() {
+                std::this_thread::sleep_for(std::chrono::microseconds(10));
+            }));
+        }
+        started.wait();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        gate.count_down(1);
+        for (auto& f : futures) {
+            f.get();
+        }
+        if (mode == SchedulingMode::WORK_STEALING) {
+            exec.execute(spawn_tree, &exec, 10, &ac, &tree_latch);
+            tree_latch.wait();
+        }
+        exec.shutdown();
+        exec.await_termination();
+        ExecutorMetrics m = exec.get_metrics();
+        uint64_t expected = 104 + (mode == SchedulingMode::WORK_STEALING ? 2047 : 0);
+        assert(m.executed == expected);
+        assert(m.queue_wait.count() == expected && m.run_time.count() == expected);
+        // The tasks queued behind the gate waited for at least 5ms
+        assert(m.queue_wait.percentile(1.0) >= std::chrono::milliseconds(4));
+        if (mode == SchedulingMode::SHARED_QUEUE) {
+            assert(m.queue_wait.percentile(0.5) >= std::chrono::milliseconds(4));
+        }
+        assert(m.run_time.percentile(1.0) >= std::chrono::milliseconds(4));
+        // Non-core workers are only added when no worker is idle, and may retire and be
+        // replaced in between
+        assert(m.threads_spawned >= 2 && m.threads_retired == m.threads_spawned);
+        assert(m.workers.empty());
+        assert(m.peak_queue_depth >= 90);
+    }
+
+    ThreadPoolExecutor plain(1, 1, 0L);
+    plain.submit([]() {}).get();
+    ExecutorMetrics m = plain.get_metrics();
+    assert(m.executed == 0 && m.workers.empty() && m.threads_spawned == 1);
+    printf("Executor metrics done\n");
+}
+
+static long join_fib(ThreadPoolExecutor* exec, int n) {
+    if (n < 2) {
+        return n;
+    }
+    auto left = exec->submit(join_fib, exec, n - 1);
+    auto right = exec->async(join_fib, exec, n - 2);
+    return exec->join(left) + exec->join(right);
+}
+
+void test_executor_join() {
+    // Every task waits for its children, which deadlocks two blocking workers at once
+    for (auto mode : {SchedulingMode::SHARED_QUEUE, SchedulingMode::WORK_STEALING}) {
+        ThreadPoolOptions options;
+        options.scheduling_mode = mode;
+        ThreadPoolExecutor exec(2, 2, 0L, options);
+        auto f = exec.submit(join_fib, &exec, 18);
+        assert(exec.join(f) == 2584);
+        assert(exec.get_pool_size() == 2);
+
+        // Shared futures and exceptions pass through
+        std::shared_future<long> shared = exec.submit([&exec]() {
+            auto child = exec.submit(join_fib, &exec, 10);
+            return exec.join(child);
+        }).share();
+        assert(exec.join(shared) == 55);
+        auto failing = exec.submit([&exec]() {
+            auto child = exec.submit([]() -> int {throw(std::runtime_error("child"));});
+            return exec.join(child);
+        });
+        bool thrown = false;
+        try {
+            exec.join(failing);
+        } catch (std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    printf("Executor join done\n");
+}
+
+void test_executor_blocking() {
+    Latch entered(2);
+    Latch cpu_done(20);
+    std::promise<void> gate;
+    std::shared_future<void> gate_future = gate.get_future().share();
+    ThreadPoolExecutor exec(2, 4, 10 * 1000000000LL);
+    assert(exec.blocking_section([](int x) {return x + 1;}, 2) == 3);
+    assert(exec.get_pool_size() == 2);
+
+    // Both core workers block, two compensating workers keep the queue moving
+    std::vector<std::future<int>> blocked;
+    for (int i = 0; i < 2; ++i) {
+        blocked.push_back(exec.submit([&exec, &entered, gate_future]() {
+            return exec.blocking_section([&entered, gate_future]() {
+                entered.count_down(1);
+                gate_future.wait();
+                return 1;
+            });
+        }));
+    }
+    entered.wait();
+    assert(exec.get_pool_size() == 4);
+    for (int i = 0; i < 20; ++i) {
+        exec.execute([&cpu_done]() {cpu_done.count_down(1);});
+    }
+    cpu_done.wait();
+
+    // The compensating workers retire once the blocking sections end
+    gate.set_value();
+    for (auto& f : blocked) {
+        assert(f.get() == 1);
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (exec.get_pool_size() > 2 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(exec.get_pool_size() == 2);
+
+    // Exceptions pass through and still end the section
+    auto failing = exec.submit([&exec]() {
+        exec.blocking_section([]() {throw(std::runtime_error("io"));});
+    });
+    bool thrown = false;
+    try {
+        failing.get();
+    } catch (std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    exec.shutdown();
+    exec.await_termination();
+    printf("Executor blocking section done\n");
+}
+
+void test_executor_adaptive_sizing() {
+    const int n = 300;
+    Latch done(n);
+    ThreadPoolOptions options;
+    options.adaptive_sizing = true;
+    options.sizing_interval = std::chrono::milliseconds(1);
+    options.target_queue_wait = std::chrono::milliseconds(1);
+    options.grow_after_samples = 2;
+    options.shrink_after_samples = 5;
+    options.min_resize_interval = std::chrono::milliseconds(2);
+    ThreadPoolExecutor exec(1, 8, 0L, options);
+    for (int i = 0; i < n; ++i) {
+        exec.execute([&done]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            done.count_down(1);
+        });
+    }
+    // A backlog only grows the pool through the controller
+    size_t peak = 0;
+    while (!done.is_ready()) {
+        peak = std::max(peak, exec.get_pool_size());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    done.wait();
+    assert(peak > 1 && peak <= 8);
+
+    // Idle non-core workers retire one at a time
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (exec.get_pool_size() > 1 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(exec.get_pool_size() == 1);
+    exec.shutdown();
+    exec.await_termination();
+
+    // Without core workers the controller starts one for the first task
+    ThreadPoolExecutor lazy(0, 2, 0L, options);
+    assert(lazy.get_pool_size() == 0);
+    assert(lazy.submit([]() {return 5;}).get() == 5);
+
+    // Bulk submitted tasks are stamped too, a short backlog waits less than the target
+    options.target_queue_wait = std::chrono::milliseconds(200);
+    ThreadPoolExecutor bulk(1, 8, 0L, options);
+    Latch bulk_done(1000);
+    bulk.execute_n(1000, [&bulk_done](size_t) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        bulk_done.count_down(1);
+    });
+    size_t bulk_peak = 0;
+    while (!bulk_done.is_ready()) {
+        bulk_peak = std::max(bulk_peak, bulk.get_pool_size());
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(bulk_peak == 1);
+    bulk.shutdown();
+    bulk.await_termination();
+    printf("Executor adaptive sizing done, peak pool size %zu\n", peak);
+}
+
 void test_thread_pool_executor() {
     std::chrono::microseconds dur;
     conc11::timed_invoke(&dur, test_executor);
@@ -136,6 +814,42 @@ void test_thread_pool_executor() {
 
     conc11::timed_invoke(&dur, test_executor_atomic);
     printf("Micros elapsed test_executor_atomic(): %lu\n", dur.count());
+
+    conc11::timed_invoke(&dur, test_executor_task_storage);
+    printf("Micros elapsed test_executor_task_storage(): %lu\n", dur.count());
+
+    conc11::timed_invoke(&dur, test_executor_bulk);
+    printf("Micros elapsed test_executor_bulk(): %lu\n", dur.count());
+
+    conc11::timed_invoke(&dur, test_executor_priority);
+    printf("Micros elapsed test_executor_priority(): %lu\n", dur.count());
+
+    conc11::timed_invoke(&dur, test_executor_fair_share);
+    printf("Micros elapsed test_executor_fair_share(): %lu\n", dur.count());
+
+    conc11::timed_invoke(&dur, test_executor_bounded_queue);
+    printf("Micros elapsed test_executor_bounded_queue(): %lu\n", dur.count());
+
+    conc11::timed_invoke(&dur, test_executor_lock_free_queue);
+    printf("Micros elapsed test_executor_lock_free_queue(): %lu\n", dur.count());
+
+    conc11::timed_invoke(&dur, test_executor_spinning);
+    printf("Micros elapsed test_executor_spinning(): %lu\n", dur.count());
+
+    conc11::timed_invoke(&dur, test_executor_metrics);
+    printf("Micros elapsed test_executor_metrics(): %lu\n", dur.count());
+
+    conc11::timed_invoke(&dur, test_executor_join);
+    printf("Micros elapsed test_executor_join(): %lu\n", dur.count());
+
+    conc11::timed_invoke(&dur, test_executor_blocking);
+    printf("Micros elapsed test_executor_blocking(): %lu\n", dur.count());
+
+    conc11::timed_invoke(&dur, test_executor_adaptive_sizing);
+    printf("Micros elapsed test_executor_adaptive_sizing(): %lu\n", dur.count());
+
+    conc11::timed_invoke(&dur, test_executor_work_stealing);
+    printf("Micros elapsed test_executor_work_stealing(): %lu\n", dur.count());
 }
 
 } // namespace test
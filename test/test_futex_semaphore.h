@@ -0,0 +1,123 @@
+/**
+ * test_futex_semaphore.h
+ */
+#ifndef TEST_TEST_FUTEX_SEMAPHORE_H_
+#define TEST_TEST_FUTEX_SEMAPHORE_H_
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "../concurrency/semaphore.h"
+
+namespace conc11 {
+
+namespace test {
+
+#if defined(__linux__)
+
+void test_futex_semaphore_basic() {
+    FutexSemaphore sem(3);
+    bool acquired = sem.try_acquire(2);
+    assert(acquired && sem.available_permits() == 1);
+    acquired = sem.try_acquire(2);
+    assert(!acquired);
+    acquired = sem.try_acquire_for(2, std::chrono::milliseconds(10));
+    assert(!acquired);
+    acquired = sem.try_acquire_until(2, std::chrono::system_clock::now() +
+            std::chrono::milliseconds(10));
+    assert(!acquired && sem.available_permits() == 1);
+    sem.release(2);
+    acquired = sem.try_acquire_for(3, 10, 0);
+    assert(acquired && sem.available_permits() == 0);
+
+    // A sleeping thread is woken by release
+    std::atomic<bool> done(false);
+    std::thread waiter([&sem, &done]() {
+        sem.acquire();
+        done.store(true);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    assert(!done.load());
+    sem.release();
+    waiter.join();
+    assert(done.load() && sem.available_permits() == 0);
+    printf("Futex semaphore basic done\n");
+}
+
+void test_futex_semaphore_weighted() {
+    // A large request sleeping first must not strand the small ones behind it
+    FutexSemaphore sem(0);
+    std::atomic<int> acquired(0);
+    std::vector<std::thread> threads;
+    unsigned int requests[] = {3, 3, 1, 1};
+    for (unsigned int request : requests) {
+        threads.emplace_back([&sem, &acquired, request]() {
+            sem.acquire(request);
+            acquired.fetch_add(1);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    sem.release(2);
+    while (acquired.load() < 2) {
+        std::this_thread::yield();
+    }
+    assert(sem.available_permits() == 0);
+    sem.release(6);
+    for (auto& th : threads) {
+        th.join();
+    }
+    assert(acquired.load() == 4 && sem.available_permits() == 0);
+    printf("Futex semaphore weighted done\n");
+}
+
+void test_futex_semaphore_contended() {
+    static const int NUM_THREADS = 32;
+    FutexSemaphore sem(8);
+    std::atomic<int> inside(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        threads.emplace_back([&sem, &inside, t]() {
+            unsigned int request = t % 3 + 1;
+            for (int i = 0; i < 500; ++i) {
+                if (i % 4 == 3) {
+                    if (!sem.try_acquire_for(request, std::chrono::microseconds(100))) {
+                        continue;
+                    }
+                } else {
+                    sem.acquire(request);
+                }
+                int n = inside.fetch_add(static_cast<int>(request)) + static_cast<int>(request);
+                assert(n <= 8);
+                inside.fetch_sub(static_cast<int>(request));
+                sem.release(request);
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    assert(sem.available_permits() == 8);
+    printf("Futex semaphore contended done\n");
+}
+
+void test_futex_semaphore() {
+    test_futex_semaphore_basic();
+    test_futex_semaphore_weighted();
+    test_futex_semaphore_contended();
+}
+
+#else
+
+void test_futex_semaphore() {
+}
+
+#endif
+
+} // namespace test
+
+} // namespace conc11
+
+#endif /* TEST_TEST_FUTEX_SEMAPHORE_H_ */
@@ -0,0 +1,119 @@
+/**
+ * test_future.h
+ */
+#ifndef TEST_TEST_FUTURE_H_
+#define TEST_TEST_FUTURE_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../concurrency/executor.h"
+#include "../concurrency/future.h"
+
+namespace conc11 {
+
+namespace test {
+
+static int square(int x) {
+    return x * x;
+}
+
+static int throw_if_negative(int x) {
+    if (x < 0) {
+        throw(std::runtime_error("negative"));
+    }
+    return x;
+}
+
+void test_future_then() {
+    auto exec = make_fixed_thread_pool(4);
+    std::vector<Future<std::string>> futures;
+    for (int i = 0; i < 10000; ++i) {
+        futures.emplace_back(exec->async(square, i)
+                .then(*exec, [](int x) {return x + 1;})
+                .then(*exec, [](int x) {return std::to_string(x);}));
+    }
+    for (int i = 0; i < 10000; ++i) {
+        assert(futures[i].get() == std::to_string(i * i + 1));
+    }
+
+    // Exceptions skip continuations and reach the end of the chain
+    bool continuation_called = false;
+    auto f = exec->async(throw_if_negative, -1).then(*exec,
+            [&continuation_called](int x) {continuation_called = true; return x;});
+    bool thrown = false;
+    try {
+        f.get();
+    } catch (std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown && !continuation_called);
+
+    // Continuation attached to an already ready future
+    assert(make_ready_future(20).then(*exec, square).get() == 400);
+
+    // Broken promise
+    Future<int> broken;
+    {
+        Promise<int> p;
+        broken = p.get_future();
+    }
+    thrown = false;
+    try {
+        broken.get();
+    } catch (std::future_error& e) {
+        thrown = e.code() == std::future_errc::broken_promise;
+    }
+    assert(thrown);
+
+    exec->shutdown();
+    exec->await_termination();
+    printf("Future then chains done\n");
+}
+
+void test_future_when_all_any() {
+    auto exec = make_cached_thread_pool();
+    std::vector<Future<int>> futures;
+    for (int i = 0; i < 1000; ++i) {
+        futures.emplace_back(exec->async(square, i));
+    }
+    std::vector<int> results = when_all(std::move(futures)).get();
+    assert(results.size() == 1000);
+    for (int i = 0; i < 1000; ++i) {
+        assert(results[i] == i * i);
+    }
+
+    std::vector<Future<void>> void_futures;
+    std::atomic<int> ctr(0);
+    for (int i = 0; i < 1000; ++i) {
+        void_futures.emplace_back(exec->async([&ctr]() {ctr.fetch_add(1);}));
+    }
+    when_all(std::move(void_futures)).then(*exec, [&ctr]() {return ctr.load();}).wait();
+    assert(ctr.load() == 1000);
+    assert(when_all(std::vector<Future<int>>()).get().empty());
+
+    Promise<int> never;
+    std::vector<Future<int>> any_futures;
+    any_futures.emplace_back(never.get_future());
+    any_futures.emplace_back(exec->async(square, 7));
+    std::pair<size_t, int> first = when_any(std::move(any_futures)).get();
+    assert(first.first == 1 && first.second == 49);
+
+    exec->shutdown();
+    exec->await_termination();
+    printf("Future when_all and when_any done\n");
+}
+
+void test_future() {
+    test_future_then();
+    test_future_when_all_any();
+}
+
+} // namespace test
+
+} // namespace conc11
+
+#endif /* TEST_TEST_FUTURE_H_ */
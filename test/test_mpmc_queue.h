@@ -0,0 +1,144 @@
+/**
+ * test_mpmc_queue.h
+ */
+#ifndef TEST_TEST_MPMC_QUEUE_H_
+#define TEST_TEST_MPMC_QUEUE_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../concurrency/mpmc_queue.h"
+
+namespace conc11 {
+
+namespace test {
+
+static const int MPMC_NUM_ITEMS = 200000;
+static const int MPMC_NUM_PRODUCERS = 4;
+static const int MPMC_NUM_CONSUMERS = 4;
+
+void test_mpmc_queue_basic() {
+    MPMCQueue<std::unique_ptr<int>> queue(5);
+    assert(queue.capacity() == 8 && queue.empty());
+    for (int lap = 0; lap < 3; ++lap) {
+        for (int i = 0; i < 8; ++i) {
+            bool pushed = queue.try_push(std::unique_ptr<int>(new int(i)));
+            assert(pushed);
+        }
+        std::unique_ptr<int> extra(new int(8));
+        bool full = !queue.try_push(std::move(extra));
+        assert(full && extra && queue.size() == 8);
+        std::unique_ptr<int> p;
+        for (int i = 0; i < 8; ++i) {
+            bool popped = queue.try_pop(&p);
+            assert(popped && *p == i);
+        }
+        assert(!queue.try_pop(&p) && queue.empty());
+    }
+
+    // Bulk operations take what fits and keep FIFO order
+    std::vector<std::unique_ptr<int>> in;
+    for (int i = 0; i < 10; ++i) {
+        in.emplace_back(new int(i));
+    }
+    size_t pushed = queue.try_push_n(std::make_move_iterator(in.begin()),
+            std::make_move_iterator(in.end()));
+    assert(pushed == 8 && in[7] == nullptr && in[8] != nullptr);
+    std::vector<std::unique_ptr<int>> out;
+    size_t popped = queue.try_pop_n(std::back_inserter(out), 5);
+    assert(popped == 5 && *out[4] == 4);
+    popped = queue.try_pop_n(std::back_inserter(out), 5);
+    assert(popped == 3 && *out[7] == 7 && queue.empty());
+
+    // Remaining elements are destroyed with the queue
+    std::shared_ptr<int> tracked = std::make_shared<int>(0);
+    {
+        MPMCQueue<std::shared_ptr<int>> q(4);
+        q.try_push(tracked);
+        q.try_push(tracked);
+        assert(tracked.use_count() == 3);
+    }
+    assert(tracked.use_count() == 1);
+    printf("MPMC queue basic done\n");
+}
+
+void test_mpmc_queue_concurrent() {
+    MPMCQueue<int> queue(64);
+    std::atomic<int> producers_left(MPMC_NUM_PRODUCERS);
+    std::vector<std::vector<int>> seen(MPMC_NUM_CONSUMERS);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < MPMC_NUM_PRODUCERS; ++p) {
+        threads.emplace_back([&queue, &producers_left, p]() {
+            int per_producer = MPMC_NUM_ITEMS / MPMC_NUM_PRODUCERS;
+            int next = p * per_producer;
+            int end = next + per_producer;
+            while (next < end) {
+                if (next % 3 == 0) {
+                    // Bulk pushes of up to 3 consecutive items
+                    int batch[3] = {next, next + 1, next + 2};
+                    int n = end - next < 3 ? end - next : 3;
+                    next += static_cast<int>(queue.try_push_n(batch, batch + n));
+                } else if (queue.try_push(next)) {
+                    ++next;
+                }
+            }
+            producers_left.fetch_sub(1);
+        });
+    }
+    for (int c = 0; c < MPMC_NUM_CONSUMERS; ++c) {
+        threads.emplace_back([&queue, &producers_left, &seen, c]() {
+            int v;
+            while (true) {
+                bool done = producers_left.load() == 0;
+                if (c % 2 == 0) {
+                    if (queue.try_pop_n(std::back_inserter(seen[c]), 4) > 0) {
+                        continue;
+                    }
+                } else if (queue.try_pop(&v)) {
+                    seen[c].push_back(v);
+                    continue;
+                }
+                if (done) {
+                    break;
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    assert(queue.empty());
+    std::vector<char> count(MPMC_NUM_ITEMS, 0);
+    int per_producer = MPMC_NUM_ITEMS / MPMC_NUM_PRODUCERS;
+    for (const auto& s : seen) {
+        // Items of one producer leave the queue in the order they entered it
+        std::vector<int> last(MPMC_NUM_PRODUCERS, -1);
+        for (int x : s) {
+            assert(x > last[x / per_producer]);
+            last[x / per_producer] = x;
+            count[x] += 1;
+        }
+    }
+    for (int i = 0; i < MPMC_NUM_ITEMS; ++i) {
+        if (count[i] != 1) {
+            printf("Item %d consumed %d times\n", i, count[i]);
+            assert(false);
+        }
+    }
+    printf("MPMC queue concurrent done\n");
+}
+
+void test_mpmc_queue() {
+    test_mpmc_queue_basic();
+    test_mpmc_queue_concurrent();
+}
+
+} // namespace test
+
+} // namespace conc11
+
+#endif /* TEST_TEST_MPMC_QUEUE_H_ */
@@ -0,0 +1,86 @@
+/**
+ * test_parallel.h
+ */
+#ifndef TEST_TEST_PARALLEL_H_
+#define TEST_TEST_PARALLEL_H_
+
+#include <cassert>
+#include <cstdio>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../concurrency/parallel.h"
+
+namespace conc11 {
+
+namespace test {
+
+void test_parallel_algorithms() {
+    static const int N = 1000000;
+    auto exec = make_fixed_thread_pool(4);
+    const Partitioning modes[] = {Partitioning::STATIC, Partitioning::DYNAMIC,
+            Partitioning::GUIDED};
+
+    for (Partitioning mode : modes) {
+        std::vector<int> v(N, 0);
+        parallel_for(*exec, 0, N, [&v](int i) {v[i] = i;}, mode);
+        for (int i = 0; i < N; ++i) {
+            assert(v[i] == i);
+        }
+
+        long long sum = parallel_reduce(*exec, v.begin(), v.end(), 0LL,
+                std::plus<long long>(), mode);
+        assert(sum == (long long) N * (N - 1) / 2);
+
+        std::vector<long long> squares(N);
+        parallel_transform(*exec, v.begin(), v.end(), squares.begin(),
+                [](int x) {return (long long) x * x;}, mode, 1000);
+        assert(squares[N - 1] == (long long) (N - 1) * (N - 1));
+    }
+
+    // Partial results are combined in range order, so op only has to be associative
+    std::vector<std::string> letters;
+    std::string expected;
+    for (int i = 0; i < 20000; ++i) {
+        letters.push_back(std::string(1, static_cast<char>('a' + i % 26)));
+        expected += letters.back();
+    }
+    for (Partitioning mode : modes) {
+        for (int run = 0; run < 20; ++run) {
+            std::string joined = parallel_reduce(*exec, letters.begin(), letters.end(),
+                    std::string(), std::plus<std::string>(), mode, 100);
+            assert(joined == expected);
+        }
+    }
+
+    // Nested parallel loops on a fixed pool do not deadlock as callers take part in the work
+    std::atomic<int> ctr(0);
+    parallel_for(*exec, 0, 64, [&exec, &ctr](int) {
+        parallel_for(*exec, 0, 1000, [&ctr](int) {ctr.fetch_add(1);});
+    });
+    assert(ctr.load() == 64000);
+
+    bool thrown = false;
+    try {
+        parallel_for(*exec, 0, N, [](int i) {
+            if (i == N / 2) {
+                throw(std::runtime_error("boom"));
+            }
+        });
+    } catch (std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    exec->shutdown();
+    exec->await_termination();
+    printf("Parallel algorithms done\n");
+}
+
+} // namespace test
+
+} // namespace conc11
+
+#endif /* TEST_TEST_PARALLEL_H_ */
@@ -5,11 +5,16 @@
 #ifndef TEST_TEST_QUEUED_SEMAPHORE_H_
 #define TEST_TEST_QUEUED_SEMAPHORE_H_
 
+#include <atomic>
+#include <cassert>
 #include <chrono>
+#include <cstdio>
+#include <mutex>
 #include <thread>
 #include <vector>
 
 #include "../concurrency/semaphore.h"
+#include "../concurrency/spin_lock.h"
 
 namespace conc11 {
 
@@ -39,6 +44,151 @@ void thread_func_nb(Semaphore *sem, int id) {
 //    printf("Non-blocking thread %d out\n", id);
 }
 
+void test_queued_semaphore_uncontended() {
+    // Permits for every thread, so that all acquisitions take the fast path
+    conc11::QueuedSemaphore<std::mutex> sem(8);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&sem]() {
+            for (int i = 0; i < 100000; ++i) {
+                sem.acquire(2);
+                sem.release(2);
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    assert(sem.available_permits() == 8);
+    printf("Queued semaphore uncontended done\n");
+}
+
+void test_queued_semaphore_fifo() {
+    static const int NUM_WAITERS = 5;
+    conc11::QueuedSemaphore<std::mutex> sem(0);
+    std::mutex order_mutex;
+    std::vector<int> order;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NUM_WAITERS; ++i) {
+        threads.emplace_back([&, i]() {
+            sem.acquire();
+            std::lock_guard<std::mutex> lock(order_mutex);
+            order.push_back(i);
+        });
+        // Let the thread block before the next one arrives
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    for (int i = 0; i < NUM_WAITERS; ++i) {
+        sem.release();
+        while (true) {
+            std::lock_guard<std::mutex> lock(order_mutex);
+            if (order.size() == static_cast<size_t>(i + 1)) {
+                break;
+            }
+        }
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    for (int i = 0; i < NUM_WAITERS; ++i) {
+        assert(order[i] == i);
+    }
+    printf("Queued semaphore FIFO done\n");
+}
+
+void test_queued_semaphore_timed() {
+    conc11::QueuedSemaphore<std::mutex> sem(0);
+    bool acquired = sem.try_acquire_for(std::chrono::milliseconds(10));
+    assert(!acquired);
+    acquired = sem.try_acquire_until(std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(10));
+    assert(!acquired);
+
+    // A waiter that times out leaves the queue without disturbing the ones behind it
+    std::atomic<bool> done(false);
+    std::thread blocked([&sem, &done]() {
+        sem.acquire(3);
+        done.store(true);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    acquired = sem.try_acquire_for(1, std::chrono::milliseconds(10));
+    assert(!acquired);
+    sem.release(3);
+    blocked.join();
+    assert(done.load() && sem.available_permits() == 0);
+
+    sem.release(2);
+    acquired = sem.try_acquire_until(2, std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(10));
+    assert(acquired && sem.available_permits() == 0);
+    printf("Queued semaphore timed done\n");
+}
+
+void test_queued_semaphore_hand_off() {
+    conc11::QueuedSemaphore<std::mutex> sem(0);
+    std::atomic<int> acquired(0);
+    std::vector<std::thread> threads;
+    unsigned int requests[] = {3, 1, 1};
+    for (unsigned int request : requests) {
+        threads.emplace_back([&sem, &acquired, request]() {
+            sem.acquire(request);
+            acquired.fetch_add(1);
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    // The head needs 3, nobody behind it may overtake it
+    sem.release(2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    assert(acquired.load() == 0 && sem.available_permits() == 2);
+    // Released permits go straight to the waiters, before they even run
+    sem.release(3);
+    assert(sem.available_permits() == 0);
+    for (auto& th : threads) {
+        th.join();
+    }
+    assert(acquired.load() == 3);
+
+    // A large request that gives up lets the smaller ones behind it through
+    std::thread large([&sem]() {
+        bool ok = sem.try_acquire_for(5, std::chrono::milliseconds(50));
+        assert(!ok);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::thread small([&sem]() {
+        sem.acquire(1);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    sem.release(2);
+    large.join();
+    small.join();
+    assert(sem.available_permits() == 1);
+    printf("Queued semaphore hand-off done\n");
+}
+
+void test_queued_semaphore_spin_lock() {
+    // Waiters park on their own thread's parker whatever the lock type, and their nodes live on
+    // their stacks
+    conc11::QueuedSemaphore<conc11::SpinLock> sem(2);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 16; ++t) {
+        threads.emplace_back([&sem, t]() {
+            for (int i = 0; i < 200; ++i) {
+                if (i % 2 == 0) {
+                    sem.acquire(t % 2 + 1);
+                    sem.release(t % 2 + 1);
+                } else if (sem.try_acquire_for(1, std::chrono::microseconds(50))) {
+                    sem.release(1);
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    assert(sem.available_permits() == 2);
+    printf("Queued semaphore with spin lock done\n");
+}
+
 void test_queued_semaphore() {
     using SemaphoreType = conc11::QueuedSemaphore<std::mutex>;
     static const int NUM_THREADS = 512;
@@ -58,6 +208,13 @@ void test_queued_semaphore() {
     for (int i = 0; i < NUM_THREADS; ++i) {
         non_blocking_threads[i].join();
     }
+    assert(sem.available_permits() == 64);
+
+    test_queued_semaphore_uncontended();
+    test_queued_semaphore_fifo();
+    test_queued_semaphore_timed();
+    test_queued_semaphore_hand_off();
+    test_queued_semaphore_spin_lock();
 }
 
 } // namespace test
@@ -0,0 +1,190 @@
+/**
+ * test_rate_limiter.h
+ */
+#ifndef TEST_TEST_RATE_LIMITER_H_
+#define TEST_TEST_RATE_LIMITER_H_
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "../concurrency/rate_limiter.h"
+#include "../concurrency/semaphore.h"
+
+namespace conc11 {
+
+namespace test {
+
+static double elapsed_millis(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since)
+            .count();
+}
+
+void test_rate_limiter_burst() {
+    RateLimiter limiter(100, 5);
+    assert(limiter.available_permits() == 5);
+    for (int i = 0; i < 5; ++i) {
+        bool acquired = limiter.try_acquire();
+        assert(acquired);
+    }
+    bool acquired = limiter.try_acquire();
+    assert(!acquired && limiter.available_permits() == 0);
+
+    // The next permit is due in 10ms: a shorter timeout fails at once, a longer one waits
+    auto start = std::chrono::steady_clock::now();
+    acquired = limiter.try_acquire_for(std::chrono::milliseconds(2));
+    assert(!acquired && elapsed_millis(start) < 2);
+    acquired = limiter.try_acquire_for(1, 100, 0);
+    double waited = elapsed_millis(start);
+    assert(acquired && waited >= 5 && waited < 100);
+
+    // Weighted requests wait for all of their permits
+    start = std::chrono::steady_clock::now();
+    limiter.acquire(3);
+    waited = elapsed_millis(start);
+    assert(waited >= 20);
+    acquired = limiter.try_acquire_until(2, std::chrono::system_clock::now() +
+            std::chrono::milliseconds(5));
+    assert(!acquired);
+    printf("Rate limiter burst done\n");
+}
+
+void test_rate_limiter_rate() {
+    // 200 permits at 1000 per second, after the first one, take 199ms however many threads ask
+    RateLimiter limiter(1000);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&limiter]() {
+            for (int i = 0; i < 50; ++i) {
+                limiter.acquire();
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    double waited = elapsed_millis(start);
+    assert(waited >= 195 && waited < 2000);
+    printf("Rate limiter rate done: 200 permits in %.1fms\n", waited);
+}
+
+void test_rate_limiter_warmup() {
+    // Starting cold, the second permit comes about 3 stable intervals after the first
+    RateLimiter cold(1000, std::chrono::milliseconds(200), 3.0);
+    bool acquired = cold.try_acquire();
+    assert(acquired);
+    acquired = cold.try_acquire_for(std::chrono::milliseconds(2));
+    assert(!acquired);
+    acquired = cold.try_acquire_for(std::chrono::milliseconds(10));
+    assert(acquired);
+
+    RateLimiter stable(1000);
+    acquired = stable.try_acquire();
+    assert(acquired);
+    acquired = stable.try_acquire_for(std::chrono::milliseconds(2));
+    assert(acquired);
+
+    // Once warm, permits come at the stable rate
+    RateLimiter warming(10000, std::chrono::milliseconds(10), 3.0);
+    for (int i = 0; i < 300; ++i) {
+        warming.acquire();
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 50; ++i) {
+        warming.acquire();
+    }
+    double waited = elapsed_millis(start);
+    assert(waited >= 4 && waited < 100);
+
+    // Permits costing less than a microsecond are still paid for, so starting cold permits taken
+    // one by one come at about a third of a stable rate of one per 100ns
+    RateLimiter fast(1e7, std::chrono::seconds(2), 3.0);
+    start = std::chrono::steady_clock::now();
+    long granted = 0;
+    while (elapsed_millis(start) < 20) {
+        if (fast.try_acquire()) {
+            ++granted;
+        }
+    }
+    assert(granted <= elapsed_millis(start) * 1e4 / 2 + 1);
+    printf("Rate limiter fast warm-up done: %ld permits in 20ms\n", granted);
+}
+
+void test_rate_limiter_long_warmup() {
+    // At a high rate with a long warm-up every permit lowers the stored ones, so full demand
+    // reaches the stable rate after the warm-up period
+    RateLimiter limiter(100000, std::chrono::seconds(2), 3.0);
+    std::atomic<long> acquired(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    // Enough threads that their reservations cover the time it takes to wake one
+    for (int t = 0; t < 16; ++t) {
+        threads.emplace_back([&]() {
+            while (!stop.load()) {
+                limiter.acquire();
+                ++acquired;
+            }
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    long cold = acquired.load();
+    double cold_millis = elapsed_millis(start);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+    long warm = acquired.load();
+    double warm_start = elapsed_millis(start);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    warm = acquired.load() - warm;
+    double warm_millis = elapsed_millis(start) - warm_start;
+    stop = true;
+    for (auto& th : threads) {
+        th.join();
+    }
+    double cold_rate = cold / cold_millis * 1000;
+    double warm_rate = warm / warm_millis * 1000;
+    assert(cold_rate < 50000 && warm_rate > 70000 && warm_rate < 110000);
+    printf("Rate limiter long warm-up done: %.0f/s cold, %.0f/s warm\n", cold_rate, warm_rate);
+}
+
+void test_rate_limiter_semaphore_interop() {
+    RateLimiter limiter(1000, 2);
+    {
+        SemaphoreGuard<RateLimiter> guard(limiter, 2);
+    }
+    SemaphoreTimedLockableAdapter<RateLimiter> adapter(limiter, 1);
+    std::unique_lock<SemaphoreTimedLockableAdapter<RateLimiter>> lock(adapter,
+            std::defer_lock);
+    bool locked = lock.try_lock();
+    assert(!locked);
+    locked = lock.try_lock_for(std::chrono::milliseconds(50));
+    assert(locked);
+    lock.unlock();
+
+    bool thrown = false;
+    try {
+        RateLimiter invalid(0);
+    } catch (const std::system_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    printf("Rate limiter semaphore interop done\n");
+}
+
+void test_rate_limiter() {
+    test_rate_limiter_burst();
+    test_rate_limiter_rate();
+    test_rate_limiter_warmup();
+    test_rate_limiter_long_warmup();
+    test_rate_limiter_semaphore_interop();
+}
+
+} // namespace test
+
+} // namespace conc11
+
+#endif /* TEST_TEST_RATE_LIMITER_H_ */
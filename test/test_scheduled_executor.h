@@ -0,0 +1,196 @@
+/**
+ * test_scheduled_executor.h
+ */
+#ifndef TEST_TEST_SCHEDULED_EXECUTOR_H_
+#define TEST_TEST_SCHEDULED_EXECUTOR_H_
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "../concurrency/latch.h"
+#include "../concurrency/scheduled_executor.h"
+
+namespace conc11 {
+
+namespace test {
+
+void test_timer_wheel() {
+    using detail::TimerNode;
+    detail::TimerWheel wheel;
+    std::vector<uint64_t> expiries = {0, 1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144,
+            300000, (1ULL << 24) - 1, 1ULL << 24, (1ULL << 24) + 5000, 1ULL << 26};
+    std::vector<std::shared_ptr<TimerNode>> nodes;
+    for (uint64_t e : expiries) {
+        nodes.emplace_back(std::make_shared<TimerNode>(UniqueTask([]() {}),
+                TimerNode::Kind::ONE_SHOT, 0, std::weak_ptr<detail::TimerQueue>()));
+        wheel.insert(nodes.back(), e);
+    }
+    // Removed timers do not fire
+    auto removed = std::make_shared<TimerNode>(UniqueTask([]() {}), TimerNode::Kind::ONE_SHOT, 0,
+            std::weak_ptr<detail::TimerQueue>());
+    wheel.insert(removed, 4096);
+    assert(wheel.size() == expiries.size() + 1);
+    assert(wheel.remove(removed.get()));
+    assert(!wheel.remove(removed.get()));
+    assert(wheel.size() == expiries.size());
+
+    std::vector<std::shared_ptr<TimerNode>> fired;
+    size_t next = 0;
+    while (next < expiries.size()) {
+        uint64_t tick = wheel.current_tick();
+        wheel.advance(&fired);
+        for (auto& node : fired) {
+            assert(node.get() == nodes[next].get());
+            assert(tick == expiries[next]);
+            ++next;
+        }
+        fired.clear();
+    }
+    assert(wheel.size() == 0);
+
+    // Expiries in the past fire on the next tick
+    wheel.insert(nodes[0], 0);
+    wheel.advance(&fired);
+    assert(fired.size() == 1);
+    printf("Timer wheel done\n");
+}
+
+void test_scheduled_executor_delays() {
+    ScheduledThreadPoolExecutor exec(4, 4, 0L);
+    auto start = std::chrono::steady_clock::now();
+    const int n = 200;
+    std::vector<std::atomic<long>> elapsed_ms(n);
+    Latch latch(n);
+    for (int i = 0; i < n; ++i) {
+        exec.schedule(std::chrono::milliseconds(i % 100), [&, i]() {
+            elapsed_ms[i] = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            latch.count_down(1);
+        });
+    }
+    latch.wait();
+    for (int i = 0; i < n; ++i) {
+        assert(elapsed_ms[i] >= i % 100);
+    }
+
+    // Cancelled tasks never run, and both ends of the wheel can be cancelled
+    std::atomic<int> ran(0);
+    ScheduledTask near = exec.schedule(std::chrono::milliseconds(30), [&ran]() {++ran;});
+    ScheduledTask far = exec.schedule(std::chrono::hours(24 * 365), [&ran]() {++ran;});
+    assert(exec.get_scheduled_count() == 2);
+    assert(near.cancel() && far.cancel());
+    assert(!near.cancel());
+    assert(near.is_cancelled() && near.is_done());
+    assert(exec.get_scheduled_count() == 0);
+    ScheduledTask done = exec.schedule(std::chrono::milliseconds(0), [&ran]() {++ran;});
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    assert(ran.load() == 1);
+    assert(done.is_done() && !done.is_cancelled() && !done.cancel());
+    // Cancelling a completed task leaves it completed
+    assert(!done.is_cancelled());
+    printf("Scheduled executor delays done\n");
+}
+
+void test_scheduled_executor_periodic() {
+    auto exec = make_scheduled_thread_pool(2);
+    std::atomic<int> rate_runs(0);
+    std::atomic<int> running(0);
+    std::atomic<bool> overlapped(false);
+    ScheduledTask rate = exec->schedule_at_fixed_rate(std::chrono::milliseconds(0),
+            std::chrono::milliseconds(2), [&]() {
+                if (running.fetch_add(1) != 0) {
+                    overlapped = true;
+                }
+                ++rate_runs;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                running.fetch_sub(1);
+            });
+    std::atomic<int> delay_runs(0);
+    ScheduledTask delay = exec->schedule_with_fixed_delay(std::chrono::milliseconds(0),
+            std::chrono::milliseconds(5), [&delay_runs]() {++delay_runs;});
+    std::atomic<int> failing_runs(0);
+    ScheduledTask failing = exec->schedule_at_fixed_rate(std::chrono::milliseconds(1),
+            std::chrono::milliseconds(1), [&failing_runs]() {
+                if (++failing_runs == 3) {
+                    throw(std::runtime_error("stop"));
+                }
+            });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    assert(rate.cancel() && delay.cancel());
+    int rate_after_cancel = rate_runs.load();
+    int delay_after_cancel = delay_runs.load();
+    assert(rate_after_cancel > 10 && delay_after_cancel > 5);
+    assert(!overlapped.load());
+    assert(failing.is_done() && !failing.is_cancelled() && failing_runs.load() == 3);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    // A run in progress while cancelling may still finish
+    assert(rate_runs.load() <= rate_after_cancel + 1);
+    assert(delay_runs.load() <= delay_after_cancel + 1);
+
+    // Shutting down cancels pending periodic tasks
+    ScheduledTask pending = exec->schedule_at_fixed_rate(std::chrono::seconds(10),
+            std::chrono::seconds(1), []() {});
+    exec->shutdown();
+    assert(pending.is_cancelled());
+    exec->await_termination();
+    bool thrown = false;
+    try {
+        exec->schedule(std::chrono::milliseconds(1), []() {});
+    } catch (std::system_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    printf("Scheduled executor periodic done\n");
+}
+
+void test_scheduled_executor_rejection() {
+    // Expiries rejected by a full queue fire again once there is room
+    ThreadPoolOptions options;
+    options.max_queue_size = 1;
+    options.rejection_policy = RejectionPolicy::THROW;
+    ScheduledThreadPoolExecutor exec(1, 1, 0L, options);
+    Latch started(1);
+    Latch gate(1);
+    exec.execute([&]() {started.count_down(1); gate.wait();});
+    started.wait();
+    exec.execute([]() {});
+    std::atomic<int> runs(0);
+    ScheduledTask periodic = exec.schedule_at_fixed_rate(std::chrono::milliseconds(0),
+            std::chrono::milliseconds(1), [&runs]() {++runs;});
+    ScheduledTask once = exec.schedule(std::chrono::milliseconds(1), [&runs]() {++runs;});
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    assert(runs.load() == 0 && exec.get_rejected_count() > 0);
+    assert(!periodic.is_done() && !once.is_done());
+    gate.count_down(1);
+    while (runs.load() < 5 || !once.is_done()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(!once.is_cancelled() && periodic.cancel());
+
+    // Shutting down the pool through the base class cancels them
+    ScheduledTask orphan = exec.schedule(std::chrono::milliseconds(5), []() {});
+    exec.ThreadPoolExecutor::shutdown();
+    while (!orphan.is_done()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(orphan.is_cancelled());
+    printf("Scheduled executor rejection done\n");
+}
+
+void test_scheduled_executor() {
+    test_timer_wheel();
+    test_scheduled_executor_delays();
+    test_scheduled_executor_periodic();
+    test_scheduled_executor_rejection();
+}
+
+} // namespace test
+
+} // namespace conc11
+
+#endif /* TEST_TEST_SCHEDULED_EXECUTOR_H_ */
@@ -0,0 +1,193 @@
+/**
+ * test_spsc_ring.h
+ */
+#ifndef TEST_TEST_SPSC_RING_H_
+#define TEST_TEST_SPSC_RING_H_
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../concurrency/spsc_ring.h"
+
+namespace conc11 {
+
+namespace test {
+
+static const int SPSC_NUM_ITEMS = 500000;
+
+void test_spsc_ring_basic() {
+    SPSCRing<std::unique_ptr<int>> ring(5);
+    assert(ring.capacity() == 8 && ring.empty());
+    for (int lap = 0; lap < 3; ++lap) {
+        for (int i = 0; i < 8; ++i) {
+            bool pushed = ring.try_push(std::unique_ptr<int>(new int(i)));
+            assert(pushed);
+        }
+        std::unique_ptr<int> extra(new int(8));
+        bool full = !ring.try_push(std::move(extra));
+        assert(full && extra && ring.full() && ring.size() == 8);
+        std::unique_ptr<int> p;
+        for (int i = 0; i < 8; ++i) {
+            bool popped = ring.try_pop(&p);
+            assert(popped && *p == i);
+        }
+        assert(!ring.try_pop(&p) && ring.empty());
+    }
+
+    // Batches take what fits and keep FIFO order
+    std::vector<std::unique_ptr<int>> in;
+    for (int i = 0; i < 10; ++i) {
+        in.emplace_back(new int(i));
+    }
+    size_t pushed = ring.try_push_n(std::make_move_iterator(in.begin()),
+            std::make_move_iterator(in.end()));
+    assert(pushed == 8 && in[7] == nullptr && in[8] != nullptr);
+    std::vector<std::unique_ptr<int>> out;
+    size_t popped = ring.try_pop_n(std::back_inserter(out), 5);
+    assert(popped == 5 && *out[4] == 4);
+    popped = ring.try_pop_n(std::back_inserter(out), 5);
+    assert(popped == 3 && *out[7] == 7 && ring.empty());
+
+    // In place access stops at the end of the ring, which is now 3 slots away
+    SPSCRing<int> ints(8);
+    int* slots;
+    std::vector<int> drained;
+    for (int i = 0; i < 5; ++i) {
+        ints.try_push(i);
+    }
+    size_t n = ints.try_pop_n(std::back_inserter(drained), 5);
+    assert(n == 5);
+    n = ints.reserve(&slots, 6);
+    assert(n == 3);
+    slots[0] = 10;
+    slots[1] = 11;
+    ints.commit(2);
+    assert(ints.size() == 2);
+    n = ints.reserve(&slots, 6);
+    assert(n == 1);
+    slots[0] = 12;
+    ints.commit(1);
+    n = ints.reserve(&slots, 6);
+    assert(n == 5);
+    slots[0] = 13;
+    ints.commit(1);
+    n = ints.peek(&slots, 10);
+    assert(n == 3 && slots[0] == 10 && slots[2] == 12);
+    ints.consume(3);
+    n = ints.peek(&slots, 10);
+    assert(n == 1 && slots[0] == 13);
+    ints.consume(1);
+    n = ints.peek(&slots, 10);
+    assert(n == 0 && ints.empty());
+    printf("SPSC ring basic done\n");
+}
+
+void test_spsc_ring_concurrent() {
+    SPSCRing<int> ring(64);
+    std::thread producer([&ring]() {
+        int next = 0;
+        while (next < SPSC_NUM_ITEMS) {
+            int before = next;
+            int* slots;
+            if (next % 3 == 0) {
+                int batch[5] = {next, next + 1, next + 2, next + 3, next + 4};
+                int n = SPSC_NUM_ITEMS - next < 5 ? SPSC_NUM_ITEMS - next : 5;
+                next += static_cast<int>(ring.try_push_n(batch, batch + n));
+            } else if (next % 3 == 1) {
+                size_t n = ring.reserve(&slots, static_cast<size_t>(SPSC_NUM_ITEMS - next));
+                for (size_t i = 0; i < n; ++i) {
+                    slots[i] = next++;
+                }
+                ring.commit(n);
+            } else if (ring.try_push(next)) {
+                ++next;
+            }
+            if (next == before) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    int expected = 0;
+    int v;
+    while (expected < SPSC_NUM_ITEMS) {
+        int before = expected;
+        int* slots;
+        if (expected % 2 == 0) {
+            size_t n = ring.peek(&slots, 7);
+            for (size_t i = 0; i < n; ++i) {
+                assert(slots[i] == expected);
+                ++expected;
+            }
+            ring.consume(n);
+        } else if (ring.try_pop(&v)) {
+            assert(v == expected);
+            ++expected;
+        }
+        if (expected == before) {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    assert(ring.empty());
+    printf("SPSC ring concurrent done\n");
+}
+
+void test_spsc_ring_blocking() {
+    // A tiny ring makes both sides wait for each other most of the time
+    SPSCRing<int, true> ring(2);
+    int v = 0;
+    bool timed_out = !ring.pop_for(&v, std::chrono::milliseconds(10));
+    assert(timed_out);
+    std::thread producer([&ring]() {
+        for (int i = 0; i < SPSC_NUM_ITEMS / 10; i += 4) {
+            if (i % 8 == 0) {
+                int batch[4] = {i, i + 1, i + 2, i + 3};
+                ring.push_n(batch, batch + 4);
+            } else {
+                for (int j = i; j < i + 4; ++j) {
+                    ring.push(std::move(j));
+                }
+            }
+        }
+    });
+    int expected = 0;
+    std::vector<int> out;
+    while (expected < SPSC_NUM_ITEMS / 10) {
+        if (expected % 3 == 0) {
+            out.clear();
+            size_t n = ring.pop_n(std::back_inserter(out), 3);
+            assert(n >= 1 && n <= 3);
+            for (int x : out) {
+                assert(x == expected);
+                ++expected;
+            }
+        } else if (expected % 3 == 1) {
+            ring.pop(&v);
+            assert(v == expected);
+            ++expected;
+        } else {
+            bool popped = ring.pop_for(&v, std::chrono::seconds(10));
+            assert(popped && v == expected);
+            ++expected;
+        }
+    }
+    producer.join();
+    assert(ring.empty());
+    printf("SPSC ring blocking done\n");
+}
+
+void test_spsc_ring() {
+    test_spsc_ring_basic();
+    test_spsc_ring_concurrent();
+    test_spsc_ring_blocking();
+}
+
+} // namespace test
+
+} // namespace conc11
+
+#endif /* TEST_TEST_SPSC_RING_H_ */
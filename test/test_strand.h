@@ -0,0 +1,209 @@
+/**
+ * test_strand.h
+ */
+#ifndef TEST_TEST_STRAND_H_
+#define TEST_TEST_STRAND_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "../concurrency/executor.h"
+#include "../concurrency/latch.h"
+#include "../concurrency/strand.h"
+
+namespace conc11 {
+
+namespace test {
+
+void test_strand_ordering() {
+    const int strands = 8;
+    const int submitters = 2;
+    const int tasks_per_submitter = 2000;
+    struct Key {
+        // Only touched by tasks of the strand, so deliberately not atomic
+        std::vector<int> last_seen = std::vector<int>(submitters, -1);
+        int count = 0;
+        std::atomic<int> running{0};
+        bool ordered = true;
+        bool overlapped = false;
+    };
+    std::vector<Key> keys(strands);
+    Latch done(strands * submitters * tasks_per_submitter);
+    auto exec = make_fixed_thread_pool(4);
+    std::vector<std::unique_ptr<Strand>> serial;
+    for (int i = 0; i < strands; ++i) {
+        serial.emplace_back(new Strand(*exec, 16));
+    }
+    std::vector<std::thread> threads;
+    for (int s = 0; s < submitters; ++s) {
+        threads.emplace_back([&, s]() {
+            for (int i = 0; i < tasks_per_submitter; ++i) {
+                for (int k = 0; k < strands; ++k) {
+                    Strand* strand = serial[k].get();
+                    strand->execute([&keys, &done, strand, k, s, i]() {
+                        Key& key = keys[k];
+                        if (key.running.fetch_add(1) != 0 || !strand->running_in_this_thread()) {
+                            key.overlapped = true;
+                        }
+                        if (key.last_seen[s] != i - 1) {
+                            key.ordered = false;
+                        }
+                        key.last_seen[s] = i;
+                        ++key.count;
+                        key.running.fetch_sub(1);
+                        done.count_down(1);
+                    });
+                }
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    done.wait();
+    for (auto& key : keys) {
+        assert(key.ordered && !key.overlapped);
+        assert(key.count == submitters * tasks_per_submitter);
+    }
+    assert(!serial[0]->running_in_this_thread());
+    assert(serial[0]->submit([](int a, int b) {return a + b;}, 2, 3).get() == 5);
+    assert(serial[0]->async([]() {return 7;}).get() == 7);
+    printf("Strand ordering done\n");
+}
+
+void test_strand_batching() {
+    // A single worker alternates between strands every batch_size tasks
+    Latch started(1);
+    Latch finished(16);
+    std::promise<void> gate;
+    std::shared_future<void> gate_future = gate.get_future().share();
+    std::string order;
+    {
+        ThreadPoolExecutor exec(1, 1, 0L);
+        Strand a(exec, 4);
+        Strand b(exec, 4);
+        exec.execute([&started, gate_future]() {
+            started.count_down(1);
+            gate_future.wait();
+        });
+        started.wait();
+        for (int i = 0; i < 8; ++i) {
+            a.execute([&order, &finished]() {
+                order += 'a';
+                finished.count_down(1);
+            });
+            b.execute([&order, &finished]() {
+                order += 'b';
+                finished.count_down(1);
+            });
+        }
+        assert(a.get_pending_count() == 8 && exec.get_queue_size() == 2);
+        gate.set_value();
+        finished.wait();
+        exec.shutdown();
+        exec.await_termination();
+        assert(a.get_pending_count() == 0 && b.get_pending_count() == 0);
+
+        // A shut down executor refuses new strand work
+        bool thrown = false;
+        try {
+            a.execute([]() {});
+        } catch (std::system_error&) {
+            thrown = true;
+        }
+        assert(thrown && a.get_pending_count() == 0);
+    }
+    assert(order == "aaaabbbbaaaabbbb");
+    printf("Strand batching done\n");
+}
+
+void test_strand_rejection() {
+    // A task queued behind one whose drain is rejected is rejected too, not stranded
+    Latch started(1);
+    Latch gate(1);
+    ThreadPoolOptions options;
+    options.max_queue_size = 1;
+    options.block_timeout = std::chrono::milliseconds(100);
+    ThreadPoolExecutor exec(1, 1, 0L, options);
+    exec.execute([&]() {started.count_down(1); gate.wait();});
+    started.wait();
+    exec.execute([]() {});
+    Strand strand(exec);
+    std::future<int> behind;
+    std::thread other([&strand, &behind]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        behind = strand.submit([]() {return 1;});
+    });
+    bool timed_out = false;
+    try {
+        strand.execute([]() {});
+    } catch (std::system_error& e) {
+        timed_out = e.code() == std::make_error_code(std::errc::timed_out);
+    }
+    other.join();
+    assert(timed_out && strand.get_pending_count() == 0);
+    bool broken = false;
+    try {
+        behind.get();
+    } catch (std::future_error& e) {
+        broken = e.code() == std::future_errc::broken_promise;
+    }
+    assert(broken);
+    gate.count_down(1);
+    assert(strand.submit([]() {return 2;}).get() == 2);
+    exec.shutdown();
+    exec.await_termination();
+
+    // Under CALLER_RUNS a drain that cannot be requeued carries on without nesting
+    options.rejection_policy = RejectionPolicy::CALLER_RUNS;
+    ThreadPoolExecutor full(1, 1, 0L, options);
+    Latch full_started(1);
+    Latch full_gate(1);
+    full.execute([&]() {full_started.count_down(1); full_gate.wait();});
+    full_started.wait();
+    full.execute([]() {});
+    Strand serial(full, 1);
+    std::thread::id caller = std::this_thread::get_id();
+    uintptr_t lowest = UINTPTR_MAX;
+    uintptr_t highest = 0;
+    int ran = 0;
+    serial.execute([&]() {
+        for (int i = 0; i < 10000; ++i) {
+            serial.execute([&]() {
+                char frame;
+                uintptr_t sp = reinterpret_cast<uintptr_t>(&frame);
+                lowest = std::min(lowest, sp);
+                highest = std::max(highest, sp);
+                if (std::this_thread::get_id() == caller) {
+                    ++ran;
+                }
+            });
+        }
+    });
+    assert(ran == 10000 && highest - lowest < 4096);
+    full_gate.count_down(1);
+    full.shutdown();
+    full.await_termination();
+    printf("Strand rejection done\n");
+}
+
+void test_strand() {
+    test_strand_ordering();
+    test_strand_batching();
+    test_strand_rejection();
+}
+
+} // namespace test
+
+} // namespace conc11
+
+#endif /* TEST_TEST_STRAND_H_ */
@@ -0,0 +1,119 @@
+/**
+ * test_task_group.h
+ */
+#ifndef TEST_TEST_TASK_GROUP_H_
+#define TEST_TEST_TASK_GROUP_H_
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include "../concurrency/executor.h"
+#include "../concurrency/latch.h"
+#include "../concurrency/task_group.h"
+
+namespace conc11 {
+
+namespace test {
+
+void test_task_group_wait() {
+    auto exec = make_fixed_thread_pool(4);
+    std::atomic<int> sum(0);
+    TaskGroup group(*exec);
+    for (int i = 1; i <= 500; ++i) {
+        bool queued = group.run([&sum](int x) {sum += x;}, i);
+        assert(queued);
+    }
+    group.wait();
+    assert(sum.load() == 500 * 501 / 2);
+    assert(group.get_queued_count() == 0 && group.get_running_count() == 0);
+
+    // Nested groups waited for inside tasks do not deadlock a small pool
+    auto pool = make_fixed_thread_pool(2);
+    std::atomic<int> leaves(0);
+    TaskGroup outer(*pool);
+    for (int i = 0; i < 4; ++i) {
+        outer.run([&pool, &leaves]() {
+            TaskGroup inner(*pool);
+            for (int j = 0; j < 8; ++j) {
+                inner.run([&leaves]() {++leaves;});
+            }
+            inner.wait();
+        });
+    }
+    outer.wait();
+    assert(leaves.load() == 32);
+
+    // The first exception cancels the group and is rethrown
+    TaskGroup failing(*exec);
+    failing.run([]() {throw(std::runtime_error("failed"));});
+    bool thrown = false;
+    try {
+        failing.wait();
+    } catch (std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown && failing.is_cancelled());
+    printf("Task group wait done\n");
+}
+
+void test_task_group_cancel() {
+    Latch started(1);
+    std::promise<void> gate;
+    std::shared_future<void> gate_future = gate.get_future().share();
+    ThreadPoolExecutor exec(1, 1, 0L);
+    std::atomic<int> ran(0);
+    std::atomic<bool> saw_cancel(false);
+    TaskGroup group(exec);
+    CancellationToken token = group.get_token();
+    group.run([&started, &saw_cancel, gate_future, token]() {
+        started.count_down(1);
+        gate_future.wait();
+        saw_cancel = token.is_cancelled();
+    });
+    started.wait();
+    for (int i = 0; i < 100; ++i) {
+        group.run([&ran]() {++ran;});
+    }
+    assert(group.get_queued_count() == 100 && group.get_running_count() == 1);
+    assert(!group.wait_for(std::chrono::milliseconds(1)));
+
+    // Queued tasks are forgotten at once, the running one sees the token
+    group.cancel();
+    assert(group.is_cancelled() && token.is_cancelled());
+    assert(group.get_queued_count() == 0 && group.get_running_count() == 1);
+    bool queued = group.run([&ran]() {++ran;});
+    assert(!queued);
+    gate.set_value();
+    group.wait();
+    assert(saw_cancel.load());
+    exec.shutdown();
+    exec.await_termination();
+    assert(ran.load() == 0);
+
+    // Tasks rejected by a shut down executor are not waited for
+    TaskGroup late(exec);
+    bool thrown = false;
+    try {
+        late.run([]() {});
+    } catch (std::system_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(late.wait_for(std::chrono::seconds(0)));
+    printf("Task group cancel done\n");
+}
+
+void test_task_group() {
+    test_task_group_wait();
+    test_task_group_cancel();
+}
+
+} // namespace test
+
+} // namespace conc11
+
+#endif /* TEST_TEST_TASK_GROUP_H_ */
@@ -0,0 +1,84 @@
+/**
+ * test_work_stealing_deque.h
+ */
+#ifndef TEST_TEST_WORK_STEALING_DEQUE_H_
+#define TEST_TEST_WORK_STEALING_DEQUE_H_
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "../concurrency/work_stealing_deque.h"
+
+namespace conc11 {
+
+namespace test {
+
+static const int WSD_NUM_ITEMS = 1000000;
+static const int WSD_NUM_THIEVES = 4;
+
+void wsd_thief_func(WorkStealingDeque<int>* deque, std::atomic<bool>* done,
+                    std::vector<int>* seen) {
+    int v;
+    while (!done->load()) {
+        if (deque->steal(&v)) {
+            seen->push_back(v);
+        }
+    }
+    while (deque->steal(&v)) {
+        seen->push_back(v);
+    }
+}
+
+void test_work_stealing_deque() {
+    WorkStealingDeque<int> deque(64);
+    std::atomic<bool> done(false);
+    std::vector<std::vector<int>> seen(WSD_NUM_THIEVES + 1);
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < WSD_NUM_THIEVES; ++i) {
+        thieves.emplace_back(wsd_thief_func, &deque, &done, &seen[i + 1]);
+    }
+    int v;
+    for (int i = 0; i < WSD_NUM_ITEMS; ++i) {
+        int item = i;
+        while (!deque.push(std::move(item))) {
+            if (deque.pop(&v)) {
+                seen[0].push_back(v);
+            }
+        }
+        if (i % 64 == 0 && deque.pop(&v)) {
+            seen[0].push_back(v);
+        }
+    }
+    while (deque.pop(&v)) {
+        seen[0].push_back(v);
+    }
+    done.store(true);
+    for (auto& th : thieves) {
+        th.join();
+    }
+    std::vector<char> count(WSD_NUM_ITEMS, 0);
+    size_t stolen = 0;
+    for (size_t i = 0; i < seen.size(); ++i) {
+        if (i > 0) {
+            stolen += seen[i].size();
+        }
+        for (int x : seen[i]) {
+            count[x] += 1;
+        }
+    }
+    for (int i = 0; i < WSD_NUM_ITEMS; ++i) {
+        if (count[i] != 1) {
+            printf("Item %d consumed %d times\n", i, count[i]);
+            assert(false);
+        }
+    }
+    printf("Work stealing deque: %lu of %d items stolen\n", stolen, WSD_NUM_ITEMS);
+}
+
+} // namespace test
+
+} // namespace conc11
+
+#endif /* TEST_TEST_WORK_STEALING_DEQUE_H_ */
@@ -0,0 +1,19 @@
+/**
+ * cache_line.h
+ */
+#ifndef UTIL_BITS_CACHE_LINE_H_
+#define UTIL_BITS_CACHE_LINE_H_
+
+#include <cstddef>
+
+namespace conc11 {
+
+/**
+ * Assumed size of a cache line, used for padding data that is written by different threads
+ * apart from each other to avoid false sharing.
+ */
+static const std::size_t CACHE_LINE_SIZE = 64;
+
+} // namespace conc11
+
+#endif /* UTIL_BITS_CACHE_LINE_H_ */
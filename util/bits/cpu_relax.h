@@ -0,0 +1,23 @@
+/**
+ * cpu_relax.h
+ */
+#ifndef UTIL_BITS_CPU_RELAX_H_
+#define UTIL_BITS_CPU_RELAX_H_
+
+namespace conc11 {
+
+/**
+ * Hint to the processor that the calling thread is in a spin-wait loop, which saves power and
+ * frees execution resources for a sibling hyper-thread. Does nothing on unknown platforms.
+ */
+inline void cpu_relax() noexcept {
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __builtin_ia32_pause();
+#elif defined(__GNUC__) && (defined(__aarch64__) || defined(__arm__))
+    __asm__ __volatile__("yield");
+#endif
+}
+
+} // namespace conc11
+
+#endif /* UTIL_BITS_CPU_RELAX_H_ */
@@ -0,0 +1,71 @@
+/**
+ * parker.h
+ */
+#ifndef UTIL_BITS_PARKER_H_
+#define UTIL_BITS_PARKER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace conc11 {
+
+/**
+ * A per-thread parking spot for building blocking primitives out of intrusive wait queues. A
+ * blocked thread links a node from its own stack into the queue of a semaphore or lock, then
+ * parks on Parker::current() until a condition on that node holds. The waker changes the node
+ * through unpark(), which holds the parker's mutex, so the parked thread cannot see the change,
+ * return and pop the node off its stack before the waker is done with both.
+ */
+class Parker {
+public:
+    Parker() {
+    }
+
+    Parker(const Parker&) = delete;
+    Parker& operator=(const Parker&) = delete;
+
+    /**
+     * The parker of the calling thread, created on its first use by the thread.
+     */
+    static Parker& current() {
+        static thread_local Parker parker;
+        return parker;
+    }
+
+    /**
+     * Block until ready() returns true. Only the owning thread may park.
+     */
+    template<class Ready>
+    void park(Ready ready) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, ready);
+    }
+
+    /**
+     * Block until ready() returns true or timeout_time is reached. Returns ready().
+     */
+    template<class Clock, class Duration, class Ready>
+    bool park_until(const std::chrono::time_point<Clock, Duration>& timeout_time, Ready ready) {
+        std::unique_lock<std::mutex> lock(mtx);
+        return cv.wait_until(lock, timeout_time, ready);
+    }
+
+    /**
+     * Run publish(), which makes ready() of the parked thread true, and wake the thread.
+     */
+    template<class Publish>
+    void unpark(Publish publish) {
+        std::lock_guard<std::mutex> lock(mtx);
+        publish();
+        cv.notify_one();
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+} // namespace conc11
+
+#endif /* UTIL_BITS_PARKER_H_ */
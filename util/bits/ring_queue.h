@@ -0,0 +1,118 @@
+/**
+ * ring_queue.h
+ */
+#ifndef UTIL_BITS_RING_QUEUE_H_
+#define UTIL_BITS_RING_QUEUE_H_
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace conc11 {
+
+/**
+ * A FIFO queue stored in a circular buffer that doubles when full and never shrinks, so a queue
+ * that has reached its working size stops allocating. Elements are required to be
+ * nothrow move constructible. Not thread safe.
+ */
+template<class T>
+class RingQueue {
+public:
+    explicit RingQueue(std::size_t initial_capacity = 64) :
+            cap(round_up_capacity(initial_capacity)), buf(new Slot[cap]) {
+    }
+
+    ~RingQueue() {
+        clear();
+    }
+
+    RingQueue(const RingQueue&) = delete;
+    RingQueue& operator=(const RingQueue&) = delete;
+
+    template<class ... Args>
+    void emplace(Args&&... args) {
+        if (count == cap) {
+            grow();
+        }
+        new (slot_at(head + count)) T(std::forward<Args>(args)...);
+        ++count;
+    }
+
+    void push(T&& value) {
+        emplace(std::move(value));
+    }
+
+    T& front() {
+        assert(count > 0);
+        return *slot_at(head);
+    }
+
+    T& back() {
+        assert(count > 0);
+        return *slot_at(head + count - 1);
+    }
+
+    void pop() {
+        assert(count > 0);
+        slot_at(head)->~T();
+        head = (head + 1) & (cap - 1);
+        --count;
+    }
+
+    void clear() noexcept {
+        while (count > 0) {
+            pop();
+        }
+    }
+
+    bool empty() const noexcept {
+        return count == 0;
+    }
+
+    std::size_t size() const noexcept {
+        return count;
+    }
+
+private:
+    using Slot = typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type;
+
+    static_assert(std::is_nothrow_move_constructible<T>::value,
+            "RingQueue requires nothrow move constructible elements");
+
+    static std::size_t round_up_capacity(std::size_t min_capacity) noexcept {
+        std::size_t c = 1;
+        while (c < min_capacity) {
+            c <<= 1;
+        }
+        return c;
+    }
+
+    T* slot_at(std::size_t index) noexcept {
+        return reinterpret_cast<T*>(&buf[index & (cap - 1)]);
+    }
+
+    void grow() {
+        std::size_t new_cap = cap << 1;
+        std::unique_ptr<Slot[]> new_buf(new Slot[new_cap]);
+        for (std::size_t i = 0; i < count; ++i) {
+            T* p = slot_at(head + i);
+            new (&new_buf[i]) T(std::move(*p));
+            p->~T();
+        }
+        buf = std::move(new_buf);
+        cap = new_cap;
+        head = 0;
+    }
+
+    std::size_t cap;
+    std::unique_ptr<Slot[]> buf;
+    std::size_t head = 0;
+    std::size_t count = 0;
+};
+
+} // namespace conc11
+
+#endif /* UTIL_BITS_RING_QUEUE_H_ */
@@ -4,6 +4,10 @@
 #ifndef UTIL_BITS_RVALUE_WRAPPER_H_
 #define UTIL_BITS_RVALUE_WRAPPER_H_
 
+#include <functional>
+#include <type_traits>
+#include <utility>
+
 namespace conc11 {
 
 /**
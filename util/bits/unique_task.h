@@ -0,0 +1,203 @@
+/**
+ * unique_task.h
+ */
+#ifndef UTIL_BITS_UNIQUE_TASK_H_
+#define UTIL_BITS_UNIQUE_TASK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace conc11 {
+
+/**
+ * A move-only, type-erased wrapper of a callable taking no arguments, like a std::function<void()>
+ * that does not require the callable to be copyable.
+ * Callables no larger than INLINE_SIZE bytes that can be moved without throwing are stored inline,
+ * so wrapping them does not allocate. Larger callables are moved to the heap.
+ * A UniqueTask occupies exactly one cache line on common 64-bit platforms.
+ */
+class UniqueTask {
+public:
+    static const std::size_t INLINE_SIZE = 48;
+
+    UniqueTask() noexcept:ops(nullptr), stamp(0) {
+    }
+
+    template<class Callable, class = typename std::enable_if<
+            !std::is_same<typename std::decay<Callable>::type, UniqueTask>::value>::type>
+    UniqueTask(Callable&& c) :
+            ops(nullptr), stamp(0) {
+        using F = typename std::decay<Callable>::type;
+        using Ops = typename std::conditional<fits_inline<F>::value,
+                InlineOps<F>, HeapOps<F>>::type;
+        Ops::construct(&storage, std::forward<Callable>(c));
+        ops = &Ops::table;
+    }
+
+    UniqueTask(UniqueTask&& rhs) noexcept:ops(rhs.ops), stamp(rhs.stamp) {
+        if (ops) {
+            ops->move(&storage, &rhs.storage);
+            rhs.ops = nullptr;
+        }
+    }
+
+    UniqueTask& operator=(UniqueTask&& rhs) noexcept {
+        if (this != &rhs) {
+            reset();
+            if (rhs.ops) {
+                rhs.ops->move(&storage, &rhs.storage);
+                ops = rhs.ops;
+                rhs.ops = nullptr;
+            }
+            stamp = rhs.stamp;
+        }
+        return *this;
+    }
+
+    UniqueTask(const UniqueTask&) = delete;
+    UniqueTask& operator=(const UniqueTask&) = delete;
+
+    ~UniqueTask() {
+        reset();
+    }
+
+    /**
+     * Invoke the stored callable. Undefined behaviour if empty.
+     */
+    void operator()() {
+        ops->invoke(&storage);
+    }
+
+    /**
+     * Destroy the stored callable, leaving this task empty.
+     */
+    void reset() noexcept {
+        if (ops) {
+            ops->destroy(&storage);
+            ops = nullptr;
+        }
+    }
+
+    explicit operator bool() const noexcept {
+        return ops != nullptr;
+    }
+
+    /**
+     * A value carried along with the task and moved with it, for bookkeeping by whoever queues
+     * the task, such as an enqueue timestamp. It occupies what would otherwise be padding.
+     */
+    int64_t get_stamp() const noexcept {
+        return stamp;
+    }
+
+    void set_stamp(int64_t value) noexcept {
+        stamp = value;
+    }
+
+    /**
+     * Returns true if the stored callable lives inside this object rather than on the heap.
+     */
+    bool is_inline() const noexcept {
+        return ops && ops->is_inline;
+    }
+
+private:
+    using Storage = typename std::aligned_storage<INLINE_SIZE,
+            std::alignment_of<std::max_align_t>::value>::type;
+
+    struct OpsTable {
+        void (*invoke)(Storage*);
+        // Move construct the callable at dst from src and destroy the one at src
+        void (*move)(Storage* dst, Storage* src) noexcept;
+        void (*destroy)(Storage*) noexcept;
+        bool is_inline;
+    };
+
+    template<class F>
+    struct fits_inline : std::integral_constant<bool,
+            sizeof(F) <= sizeof(Storage) &&
+            std::alignment_of<Storage>::value % std::alignment_of<F>::value == 0 &&
+            std::is_nothrow_move_constructible<F>::value> {
+    };
+
+    template<class F>
+    struct InlineOps {
+        template<class Callable>
+        static void construct(Storage* s, Callable&& c) {
+            new (s) F(std::forward<Callable>(c));
+        }
+
+        static F* get(Storage* s) noexcept {
+            return reinterpret_cast<F*>(s);
+        }
+
+        static void invoke(Storage* s) {
+            (*get(s))();
+        }
+
+        static void move(Storage* dst, Storage* src) noexcept {
+            new (dst) F(std::move(*get(src)));
+            get(src)->~F();
+        }
+
+        static void destroy(Storage* s) noexcept {
+            get(s)->~F();
+        }
+
+        static const OpsTable table;
+    };
+
+    template<class F>
+    struct HeapOps {
+        template<class Callable>
+        static void construct(Storage* s, Callable&& c) {
+            *reinterpret_cast<F**>(s) = new F(std::forward<Callable>(c));
+        }
+
+        static F*& get(Storage* s) noexcept {
+            return *reinterpret_cast<F**>(s);
+        }
+
+        static void invoke(Storage* s) {
+            (*get(s))();
+        }
+
+        static void move(Storage* dst, Storage* src) noexcept {
+            *reinterpret_cast<F**>(dst) = get(src);
+            get(src) = nullptr;
+        }
+
+        static void destroy(Storage* s) noexcept {
+            delete get(s);
+        }
+
+        static const OpsTable table;
+    };
+
+    Storage storage;
+    const OpsTable* ops;
+    int64_t stamp;
+};
+
+template<class F>
+const UniqueTask::OpsTable UniqueTask::InlineOps<F>::table = {
+        &UniqueTask::InlineOps<F>::invoke,
+        &UniqueTask::InlineOps<F>::move,
+        &UniqueTask::InlineOps<F>::destroy,
+        true
+};
+
+template<class F>
+const UniqueTask::OpsTable UniqueTask::HeapOps<F>::table = {
+        &UniqueTask::HeapOps<F>::invoke,
+        &UniqueTask::HeapOps<F>::move,
+        &UniqueTask::HeapOps<F>::destroy,
+        false
+};
+
+} // namespace conc11
+
+#endif /* UTIL_BITS_UNIQUE_TASK_H_ */
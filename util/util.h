@@ -5,9 +5,13 @@
 #ifndef UTIL_UTIL_H_
 #define UTIL_UTIL_H_
 
+#include "bits/cache_line.h"
+#include "bits/cpu_relax.h"
 #include "bits/rvalue_wrapper.h"
 #include "bits/scope_guard.h"
 #include "bits/invoke.h"
 #include "bits/make_unique.h"
+#include "bits/ring_queue.h"
+#include "bits/unique_task.h"
 
 #endif /* UTIL_UTIL_H_ */